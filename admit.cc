@@ -0,0 +1,126 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// admit.cc -- Admission class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "admit.h"
+#include "phoenix.h"
+
+AdmitHost Admission::table[AdmitTableSize]; // hash table of hosts
+int Admission::refused = 0;		// connections refused
+int Admission::untracked = 0;		// connections admitted with table full
+
+static const char *RefuseMessage =	// sent to refused connections
+   "\r\nToo many connections from your host.  Please try again later.\r\n";
+
+static unsigned int Hash(in_addr_t addr) // Hash address into table.
+{
+   return (ntohl(addr) * 2654435761u) & (AdmitTableSize - 1);
+}
+
+// Refill host's tokens for time elapsed.
+void Admission::Refill(AdmitHost *host, time_t now)
+{
+   int gained = (now - host->stamp) / AdmitInterval;
+
+   if (host->tokens + gained >= AdmitBurst) {
+      host->tokens = AdmitBurst;
+      host->stamp = now;
+   } else if (gained > 0) {
+      host->tokens += gained;
+      host->stamp += gained * AdmitInterval;
+   }
+}
+
+// Find host, or add it in the first free slot.  Hosts are never placed
+// after a never-used slot, so the search can stop at one.  Returns NULL if
+// there's no room within AdmitProbes slots.
+AdmitHost *Admission::Find(in_addr_t addr, time_t now)
+{
+   unsigned int i = Hash(addr);
+   AdmitHost *host, *free = NULL;
+
+   for (int n = 0; n < AdmitProbes; n++, i = (i + 1) & (AdmitTableSize - 1)) {
+      host = &table[i];
+      if (host->addr == addr) {
+         Refill(host, now);
+         return host;
+      }
+      if (!host->addr) {
+         if (!free) free = host;
+         break;
+      }
+      if (!free && !host->conns) {
+         Refill(host, now);
+         if (host->tokens == AdmitBurst) free = host; // Idle, reusable.
+      }
+   }
+   if (free) {
+      free->addr = addr;
+      free->conns = 0;
+      free->tokens = AdmitBurst;
+      free->refused = 0;
+      free->stamp = now;
+   }
+   return free;
+}
+
+// Admit new connection, or refuse it with a single write and close it.
+bool Admission::Admit(int sock, in_addr_t addr)
+{
+   AdmitHost *host = Find(addr, time(NULL));
+   struct in_addr in;
+
+   if (!host) {				// Table crowded, fail open.
+      untracked++;
+      return true;
+   }
+   if (host->conns < AdmitMaxConns && host->tokens) {
+      host->tokens--;
+      host->refused = 0;
+      return true;
+   }
+   write(sock, RefuseMessage, strlen(RefuseMessage));
+   close(sock);
+   refused++;
+   if (!host->refused++) {		// Log the first of a run only.
+      in.s_addr = addr;
+      log_message("Refusing connections from %s. (%d connected)",
+                  inet_ntoa(in), host->conns);
+   }
+   return false;
+}
+
+// Count connection from host, returning false if it can't be tracked.
+bool Admission::Attach(in_addr_t addr)
+{
+   AdmitHost *host = Find(addr, time(NULL));
+
+   if (!host) return false;
+   host->conns++;
+   return true;
+}
+
+void Admission::Release(in_addr_t addr)	// Connection from host closed.
+{
+   unsigned int i = Hash(addr);
+
+   for (int n = 0; n < AdmitProbes; n++, i = (i + 1) & (AdmitTableSize - 1)) {
+      if (!table[i].addr) return;
+      if (table[i].addr == addr) {
+         if (table[i].conns) table[i].conns--;
+         return;
+      }
+   }
+}
+
+void Admission::LogStats()		// Log admission statistics.
+{
+   log_message("Refused %d connections, %d admitted untracked.", refused,
+               untracked);
+}
@@ -0,0 +1,46 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// admit.h -- Admission class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _ADMIT_H
+#define _ADMIT_H 1
+
+// Include files.
+#include "phoenix.h"
+
+// Admission state for one source address.
+struct AdmitHost {
+   in_addr_t addr;			// source address (0 if slot never used)
+   unsigned short conns;		// current connections
+   unsigned short tokens;		// connect tokens available
+   unsigned short refused;		// connections refused since last admit
+   time_t stamp;			// time tokens were last refilled
+};
+
+// Per-host admission control for new connections, checked before a Telnet
+// (and Session and User) is created.  Each host is limited to a number of
+// concurrent connections and a token-bucket connect rate.  Hosts live in a
+// fixed open-addressed hash table; a slot is reused once its host has no
+// connections and a full bucket, so the table never needs deletions.
+class Admission {
+private:
+   static AdmitHost table[AdmitTableSize]; // hash table of hosts
+   static int refused;			// connections refused
+   static int untracked;		// connections admitted with table full
+
+   static AdmitHost *Find(in_addr_t addr, time_t now); // Find/add host.
+   static void Refill(AdmitHost *host, time_t now); // Refill host's tokens.
+public:
+   static bool Admit(int sock, in_addr_t addr); // Admit or refuse connection.
+   static bool Attach(in_addr_t addr);	// Count connection from host.
+   static void Release(in_addr_t addr);	// Connection from host closed.
+   static void LogStats();		// Log admission statistics.
+};
+
+#endif // admit.h
@@ -0,0 +1,185 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// binary.cc -- Binary class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "admit.h"
+#include "binary.h"
+#include "phoenix.h"
+#include "session.h"
+
+// Binary constructor, for a (non-blocking) connection accepted by Listen.
+Binary::Binary(int sock, struct sockaddr_in &saddr)
+{
+   type = BinaryFD;			// Identify as a Binary FD.
+
+   // Input buffer holds one record at a time.
+   delete[] data;
+   data = point = free = new char[BinaryRecordSize];
+   end = data + BinaryRecordSize;
+
+   LSGA = RSGA = TelnetEnabled;		// Never any Go Aheads.
+
+   fd = sock;				// Save accepted TCP connection.
+   LogCaller(saddr);			// Log calling host and port.
+   if (Admission::Attach(saddr.sin_addr.s_addr)) addr = saddr.sin_addr.s_addr;
+
+   session = new Session(this);		// Create a new Session.
+
+   ReadSelect();			// Select new connection for reading.
+   Welcome();				// Nothing to negotiate.
+   SetIdleTimer();			// Start login timer.
+}
+
+Binary::Binary()			// Binary constructor. (handed-off)
+{
+   type = BinaryFD;			// Identify as a Binary FD.
+}
+
+void Binary::Frame(OutputRecord &rec)	// Queue record for output.
+{
+   char tmp[BlockSize];
+   int n = rec.WireSize();
+   char *buf = n <= BlockSize ? tmp : new char[n];
+
+   rec.PackWire(buf);
+   if (Output.out(buf, n) && !blocked) WriteSelect();
+   if (buf != tmp) delete[] buf;
+}
+
+void Binary::output(int byte)		// queue output byte
+{
+   char c = byte;
+
+   output(&c, 1);
+}
+
+void Binary::output(const char *buf)	// queue output data
+{
+   if (!buf || !*buf) return;		// return if no data
+   output(buf, strlen(buf));
+}
+
+void Binary::output(const char *buf, int len) // queue output data (with length)
+{
+   OutputRecord rec;
+   char *text;
+
+   if (!buf || !len) return;		// return if no data
+   text = new char[len + 1];
+   memcpy(text, buf, len);
+   text[len] = 0;
+   rec.type = TextOutput;
+   time(&rec.time);
+   rec.text = text;
+   Frame(rec);
+   delete[] text;
+}
+
+void Binary::Send(::Output *out)	// Send output object.
+{
+   OutputRecord rec;
+
+   out->Save(rec);
+   Frame(rec);
+}
+
+void Binary::Prompt(const char *p)	// Send and set new prompt.
+{
+   OutputRecord rec;
+
+   session->EnqueueOutput();
+   if (dirty) Render();			// Keep output ahead of prompt.
+   prompt_len = strlen(p);
+   if (prompt) delete prompt;
+   prompt = new char[prompt_len + 1];
+   strcpy(prompt, p);
+   rec.type = PromptOutput;
+   time(&rec.time);
+   rec.text = prompt;
+   Frame(rec);
+}
+
+void Binary::Record(OutputRecord &rec)	// Process record from client.
+{
+   const char *s;
+   char *line, *p;
+
+   if (!session) return;
+   switch (rec.type) {
+   case TextOutput:
+      session->Input(this, rec.text);	// Input line, as if typed.
+      break;
+   case PublicMessage:
+   case PrivateMessage:
+   case ChannelMessage:
+      // Quote the sendlist and send it as an explicit message line, so
+      // it goes through the same checks (and flood control) as any other.
+      s = rec.type == PublicMessage ? "everyone" : rec.to;
+      p = line = new char[2 * strlen(s) + strlen(rec.text) + 3];
+      if (rec.type == ChannelMessage) *p++ = '#';
+      for (; *s; s++) {
+         if (!isalnum(*s)) *p++ = Backslash;
+         *p++ = *s;
+      }
+      *p++ = Colon;
+      strcpy(p, rec.text);
+      session->Input(this, line);
+      delete[] line;
+      break;
+   default:
+      break;				// Ignore anything else.
+   }
+}
+
+// Decode the big-endian length at the start of a binary record.
+static int RecordLength(const char *buf)
+{
+   const unsigned char *p = (const unsigned char *) buf;
+
+   return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Process input records, up to the line budget.  A record split across
+// reads is kept in the input buffer until the rest arrives.
+int Binary::Receive(const char *buf, int len)
+{
+   OutputRecord rec;
+   const char *from = buf, *from_end = buf + len;
+   int size, n;
+
+   line_budget = LineBudget;		// Fresh line budget.
+   while (from < from_end && line_budget > 0 && fd != -1) {
+      // Collect the record length first, then the rest of the record.
+      size = 4;
+      if (free - data >= 4) size = RecordLength(data);
+      n = size - (free - data);
+      if (n > from_end - from) n = from_end - from;
+      memcpy(free, from, n);
+      from += n;
+      free += n;
+      if (free - data < 4) continue;
+      size = RecordLength(data);
+      if (size <= 4 || size > end - data) {
+         log_message("Invalid binary record on fd #%d, closing.", fd);
+         Close(false);
+         return len;
+      }
+      if (free - data < size) continue;
+
+      point = free = data;		// Record complete.
+      if (!rec.UnpackWire(data, size)) {
+         log_message("Invalid binary record on fd #%d, closing.", fd);
+         Close(false);
+         return len;
+      }
+      line_budget--;			// Count against line budget.
+      Record(rec);
+   }
+   return from - buf;
+}
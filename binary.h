@@ -0,0 +1,51 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// binary.h -- Binary class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _BINARY_H
+#define _BINARY_H 1
+
+// Include files.
+#include "output.h"
+#include "phoenix.h"
+#include "telnet.h"
+
+// Binary protocol connection for bots and bridges (subclass of Telnet).
+//
+// Both directions are a stream of packed OutputRecords in network order: a
+// 4-byte big-endian total length, a type byte, a flags byte, 2 zero bytes and
+// an 8-byte big-endian timestamp, then the name, from, to and text strings,
+// each null-terminated.  Output objects are sent
+// as their records, with no telnet escaping, word wrapping, input line
+// redraw or TIMING-MARK acknowledgements; other text (command responses and
+// the like) is sent as TextOutput records, and each prompt as a PromptOutput
+// record.  From the client, TextOutput records are input lines, as if typed,
+// and PublicMessage, PrivateMessage and ChannelMessage records are messages
+// to everyone, to the "to" sendlist, or to the "to" channel.  A private
+// message to several people lists them in "to" separated by newlines; a
+// client sends one with a comma-separated sendlist.  Any number of records
+// may be sent in one write.
+class Binary: public Telnet {
+protected:
+   void Frame(OutputRecord &rec);	// Queue record for output.
+   void Record(OutputRecord &rec);	// Process record from client.
+public:
+   Binary(int sock, struct sockaddr_in &saddr); // constructor
+   Binary();				// constructor (handed-off connection)
+   void output(int byte);		// queue output byte
+   void output(const char *buf);	// queue output data
+   void output(const char *buf, int len); // queue output data (with length)
+   void Send(::Output *out);		// Send output object.
+   void Prompt(const char *p);		// Send and set new prompt.
+   void UndrawInput() { }		// No input line to erase.
+   void RedrawInput() { }		// No input line to redraw.
+   int Receive(const char *buf, int len); // Process input, up to budget.
+};
+
+#endif // binary.h
@@ -0,0 +1,89 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// bitset.h -- Bitset class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _BITSET_H
+#define _BITSET_H 1
+
+// Include files.
+#include "phoenix.h"
+
+// Dense set of small non-negative integers (session slots), kept as an array
+// of machine words which grows as needed.  Union and walking the members go
+// a whole word at a time.
+class Bitset {
+private:
+   static const int WordBits = 8 * sizeof(unsigned long);
+   unsigned long *bits;			// member bits
+   int words;				// words allocated
+
+   Bitset(const Bitset &);		// not copyable
+   Bitset &operator =(const Bitset &);
+   void Grow(int n) {			// Grow to hold n words.
+      unsigned long *tmp = new unsigned long[n];
+
+      if (words) memcpy(tmp, bits, words * sizeof(unsigned long));
+      memset(tmp + words, 0, (n - words) * sizeof(unsigned long));
+      if (bits) delete[] bits;
+      bits = tmp;
+      words = n;
+   }
+public:
+   Bitset() {				// constructor
+      bits = NULL;
+      words = 0;
+   }
+   ~Bitset() {				// destructor
+      if (bits) delete[] bits;
+   }
+   bool In(int i) {			// Is i a member?
+      return i >= 0 && i / WordBits < words &&
+         (bits[i / WordBits] >> (i % WordBits) & 1);
+   }
+   void Add(int i) {			// Add member.
+      if (i < 0) return;
+      if (i / WordBits >= words) Grow(i / WordBits + 1);
+      bits[i / WordBits] |= 1UL << (i % WordBits);
+   }
+   void Remove(int i) {			// Remove member.
+      if (i >= 0 && i / WordBits < words) {
+         bits[i / WordBits] &= ~(1UL << (i % WordBits));
+      }
+   }
+   void Union(Bitset &set) {		// Add all members of set.
+      if (set.words > words) Grow(set.words);
+      for (int w = 0; w < set.words; w++) bits[w] |= set.bits[w];
+   }
+   int Count() {			// Count of members.
+      int n = 0;
+
+      for (int w = 0; w < words; w++) n += __builtin_popcountl(bits[w]);
+      return n;
+   }
+   int Next(int i) {			// First member from i on, or -1.
+      unsigned long x;
+      int w = i / WordBits;
+
+      if (i < 0 || w >= words) return -1;
+      x = bits[w] & (~0UL << (i % WordBits));
+      while (!x) {
+         if (++w >= words) return -1;
+         x = bits[w];
+      }
+      return w * WordBits + __builtin_ctzl(x);
+   }
+   int FirstFree() {			// Lowest non-member.
+      int w;
+
+      for (w = 0; w < words && !~bits[w]; w++) ;
+      return w * WordBits + (w < words ? __builtin_ctzl(~bits[w]) : 0);
+   }
+};
+
+#endif // bitset.h
@@ -0,0 +1,122 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// channel.cc -- Channel class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "channel.h"
+#include "handoff.h"
+#include "phoenix.h"
+#include "session.h"
+
+Pointer<Channel> Channel::channels;	// List of all channels. (global)
+
+Channel::Channel(const char *str)	// constructor
+{
+   strncpy(name, str, NameLen);
+   name[NameLen - 1] = 0;
+   next = NULL;				// No next channel.
+}
+
+// Is str a valid channel name?  (letters, digits, "-" and "_")
+bool Channel::ValidName(const char *str)
+{
+   const char *p;
+
+   if (!*str || strlen(str) >= NameLen) return false;
+   for (p = str; *p; p++) {
+      if (!isalnum(*p) && *p != '-' && *p != Underscore) return false;
+   }
+   return true;
+}
+
+Channel *Channel::Find(const char *str)	// Find channel by name.
+{
+   Channel *channel;
+
+   for (channel = channels; channel; channel = channel->next) {
+      if (!strcasecmp(channel->name, str)) return channel;
+   }
+   return NULL;
+}
+
+// Join channel by name, creating it if need be.
+Channel *Channel::Join(const char *str, int slot)
+{
+   Channel *channel;
+
+   if (!(channel = Find(str))) {
+      channel = new Channel(str);
+      channel->next = channels;		// Link channel into global list.
+      channels = channel;
+   }
+   channel->members.Add(slot);
+   return channel;
+}
+
+void Channel::Leave(int slot)		// Leave, deleting channel if empty.
+{
+   Pointer<Channel> keep(this), c(channels);
+
+   members.Remove(slot);
+   if (members.Next(0) >= 0) return;
+   if (channels == this) {		// Unlink empty channel from list.
+      channels = next;
+   } else {
+      while (c && c->next != this) c = c->next;
+      if (c) c->next = next;
+   }
+}
+
+void Channel::LeaveAll(int slot)	// Leave all channels.
+{
+   Pointer<Channel> channel, next;
+
+   for (channel = channels; channel; channel = next) {
+      next = channel->next;
+      if (channel->members.In(slot)) channel->Leave(slot);
+   }
+}
+
+void Channel::Save(Handoff &h)		// Save channels for handoff.
+{
+   Channel *channel;
+   int i, n = 0;
+
+   for (channel = channels; channel; channel = channel->next) n++;
+   h.PutInt(n);
+   for (channel = channels; channel; channel = channel->next) {
+      h.PutString(channel->name);
+      h.PutInt(channel->members.Count());
+      for (i = channel->members.Next(0); i >= 0;
+           i = channel->members.Next(i + 1)) {
+         h.PutInt(i);
+      }
+   }
+}
+
+void Channel::Restore(Handoff &h)	// Restore channels from handoff.
+{
+   Pointer<Channel> *list;
+   char name[NameLen];
+   int i, j, n = h.GetInt();
+
+   if (n <= 0 || !h.Ok()) return;
+   list = new Pointer<Channel>[n];
+   for (i = 0; i < n && h.Ok(); i++) {
+      h.GetString(name, NameLen);
+      list[i] = new Channel(name);
+      for (j = h.GetInt(); j > 0 && h.Ok(); j--) {
+         list[i]->members.Add(h.GetInt());
+      }
+   }
+   while (i-- > 0) {
+      list[i]->next = channels;
+      channels = list[i];
+   }
+   delete[] list;
+}
@@ -0,0 +1,42 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// channel.h -- Channel class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _CHANNEL_H
+#define _CHANNEL_H 1
+
+// Include files.
+#include "bitset.h"
+#include "object.h"
+#include "phoenix.h"
+
+// Named discussion channel.  Members are kept as a dense set of session
+// slots (see Session::TakeSlot()), so sending to a channel is a walk over
+// its member bits, and sets of recipients can be combined with a union.
+// A channel exists as long as it has any members.
+class Channel: public Object {
+protected:
+   static Pointer<Channel> channels;	// List of all channels. (global)
+public:
+   Pointer<Channel> next;		// next channel
+   char name[NameLen];			// channel name (without "#")
+   Bitset members;			// member session slots
+
+   Channel(const char *str);		// constructor
+   static Channel *First() { return channels; } // First channel in list.
+   static bool ValidName(const char *str); // Is str a valid channel name?
+   static Channel *Find(const char *str); // Find channel by name.
+   static Channel *Join(const char *str, int slot); // Join, maybe create.
+   void Leave(int slot);		// Leave, deleting channel if empty.
+   static void LeaveAll(int slot);	// Leave all channels.
+   static void Save(Handoff &h);	// Save channels for handoff.
+   static void Restore(Handoff &h);	// Restore channels from handoff.
+};
+
+#endif // channel.h
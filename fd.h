@@ -17,7 +17,7 @@
 #include "phoenix.h"
 
 // Types of FD subclasses.
-enum FDType {UnknownFD, ListenFD, TelnetFD};
+enum FDType {UnknownFD, ListenFD, TelnetFD, SignalFD, BinaryFD};
 
 // Data about a particular file descriptor.
 class FD: public Object {
@@ -26,16 +26,42 @@ protected:
 public:
    FDType type;				// type of file descriptor
    int fd;				// file descriptor
+   bool deferred;			// on ready queue?
+   bool flushing;			// on flush queue?
+   bool saved;				// written to handoff?
+
+   FD(): deferred(false), flushing(false), saved(false) { } // constructor
 
    // Close all file descriptors.
    static void CloseAll() { fdtable.CloseAll(); }
 
+   // Close all but listening sockets.
+   static void CloseConnections() { fdtable.CloseConnections(); }
+
+   // Pass listening sockets to the next server.
+   static void PassListen() { fdtable.PassListen(); }
+
    // Select across all ready connections.
    static void Select() { fdtable.Select(); }
 
+   // Save listening sockets for handoff.
+   static void Save(Handoff &h) { fdtable.Save(h); }
+
+   // Restore listening sockets from handoff.
+   static void Restore(Handoff &h) { fdtable.Restore(h); }
+
+   // Sessions of connections still logging in, for handoff.
+   static void Logins(List<Session> &list) { fdtable.Logins(list); }
+
+   // Close fds not written to handoff on exec().
+   static void CloseOnExec() { fdtable.CloseOnExec(); }
+
    virtual void InputReady() = 0;	// Input ready on file descriptor fd.
    virtual void OutputReady() = 0;	// Output ready on file descriptor fd.
    virtual void Closed() = 0;		// Connection is closed.
+   virtual void Flush() {		// Write pending output now.
+      if (fd != -1 && fdtable.WriteSelected(fd)) OutputReady();
+   }
    virtual ~FD() {}			// destructor
    void NonBlocking() {			// Place fd in non-blocking mode.
       int flags;
@@ -54,8 +80,23 @@ public:
    void NoReadSelect() {		// Do not select fd for reading.
       if (fd != -1) fdtable.NoReadSelect(fd);
    }
+   void Defer() {			// Take another turn after others.
+      if (fd != -1 && !deferred) {
+         deferred = true;
+         fdtable.Defer(this);
+      }
+   }
+   void QueueFlush() {			// Flush at end of dispatch pass.
+      if (fd != -1 && !flushing) {
+         flushing = true;
+         fdtable.Flush(this);
+      }
+   }
    void WriteSelect() {			// Select fd for writing.
-      if (fd != -1) fdtable.WriteSelect(fd);
+      if (fd != -1) {
+         fdtable.WriteSelect(fd);
+         QueueFlush();			// Try writing before next select().
+      }
    }
    void NoWriteSelect() {		// Do not select fd for writing.
       if (fd != -1) fdtable.NoWriteSelect(fd);
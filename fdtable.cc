@@ -8,7 +8,9 @@
 //
 
 // Include files.
+#include "binary.h"
 #include "fdtable.h"
+#include "handoff.h"
 #include "listen.h"
 #include "name.h"
 #include "outbuf.h"
@@ -16,7 +18,9 @@
 #include "outstr.h"
 #include "phoenix.h"
 #include "session.h"
+#include "sigfd.h"
 #include "telnet.h"
+#include "timer.h"
 #include "user.h"
 
 FDTable FD::fdtable;			// File descriptor table.
@@ -38,23 +42,103 @@ FDTable::~FDTable()			// destructor
    delete[] array;
 }
 
-void FDTable::OpenListen(int port)	// Open a listening port.
+void FDTable::OpenListen(int port, bool binary) // Open a listening port.
 {
-   Pointer<Listen> l(new Listen(port));
+   Pointer<Listen> l(new Listen(port, binary));
    if (l->fd == -1) return;
    if (l->fd >= used) used = l->fd + 1;
    array[l->fd] = l;
    l->ReadSelect();
 }
 
-void FDTable::OpenTelnet(int lfd)	// Open a telnet connection.
+// Open a telnet (or binary protocol) connection on an accepted socket.
+void FDTable::OpenTelnet(int fd, struct sockaddr_in &saddr, bool binary)
 {
-   Pointer<Telnet> t(new Telnet(lfd));
+   Pointer<Telnet> t(binary ? new Binary(fd, saddr) : new Telnet(fd, saddr));
    if (t->fd == -1) return;
    if (t->fd >= used) used = t->fd + 1;
    array[t->fd] = t;
 }
 
+void FDTable::OpenSignal()		// Open signalfd.
+{
+   Pointer<Signal> s(new Signal);
+   if (s->fd == -1) return;
+   if (s->fd >= used) used = s->fd + 1;
+   array[s->fd] = s;
+   s->ReadSelect();
+}
+
+void FDTable::Adopt(FD *f)		// Add an already-open FD object.
+{
+   if (f->fd == -1) return;
+   if (f->fd >= used) used = f->fd + 1;
+   array[f->fd] = f;
+}
+
+// Add an already-listening socket.
+void FDTable::AdoptListen(int fd, bool binary)
+{
+   Pointer<Listen> l(new Listen);
+   l->fd = fd;
+   l->binary = binary;
+   l->NonBlocking();
+   Adopt(l);
+   l->ReadSelect();
+}
+
+void FDTable::Save(Handoff &h)		// Save listening sockets for handoff.
+{
+   int i, n = 0;
+
+   for (i = 0; i < used; i++) {
+      if (array[i] && array[i]->type == ListenFD) n++;
+   }
+   h.PutInt(n);
+   for (i = 0; i < used; i++) {
+      if (array[i] && array[i]->type == ListenFD) {
+         h.PutInt(i);
+         h.PutInt(((Listen *) (FD *) array[i])->binary);
+         array[i]->saved = true;
+      }
+   }
+}
+
+// Sessions of connections still logging in aren't on the session list, but
+// are handed off with the rest.
+void FDTable::Logins(List<Session> &list)
+{
+   Telnet *t;
+
+   for (int i = 0; i < used; i++) {
+      if (!array[i] || (array[i]->type != TelnetFD &&
+                        array[i]->type != BinaryFD)) continue;
+      t = (Telnet *) (FD *) array[i];
+      if (t->session && !t->session->SignedOn) list.AddTail(t->session);
+   }
+}
+
+// Close every fd not written to the handoff on exec(), such as connections
+// still draining after logout, so none leaks into the new server unowned.
+void FDTable::CloseOnExec()
+{
+   for (int i = 0; i < used; i++) {
+      if (!array[i]) continue;
+      fcntl(i, F_SETFD, array[i]->saved ? 0 : FD_CLOEXEC);
+      array[i]->saved = false;		// Decide afresh next time.
+   }
+}
+
+void FDTable::Restore(Handoff &h)	// Restore listening sockets.
+{
+   int n = h.GetInt(), fd;
+
+   while (n-- > 0 && h.Ok()) {
+      fd = h.GetInt();
+      AdoptListen(fd, h.GetInt());
+   }
+}
+
 Pointer<FD> FDTable::Closed(int fd)	// Close fd, return FD object pointer.
 {
    if (fd < 0 || fd >= used) return NULL;
@@ -82,17 +166,96 @@ void FDTable::CloseAll() {		// Close all fds.
    used = 0;
 }
 
+void FDTable::CloseConnections()	// Close all but listening sockets.
+{
+   for (int i = 0; i < used; i++) {
+      if (array[i] && array[i]->type != ListenFD) Close(i);
+   }
+}
+
+// Pass listening sockets to the next server, renumbered from fd 3 up, in the
+// environment as a service manager would for socket activation.  Each is
+// named "telnet" or "binary" in LISTEN_FDNAMES, so it keeps its protocol.
+// Connections arriving meanwhile just wait in the listen backlog instead of
+// being refused.
+//
+// Connections, the journal and the log file must already be closed, since
+// they may hold the fds the listening sockets are renumbered to.
+void FDTable::PassListen()
+{
+   char buf[32], names[BufSize];
+   int *fds = new int[used + 1];
+   int i, n = 0, top;
+
+   // First move the listening sockets above the fds they will end up on, so
+   // renumbering them can't overwrite one of them.  Anything else still in
+   // the table (such as the signalfd) stays where it is.
+   for (i = 0; i < used; i++) {
+      if (array[i] && array[i]->type == ListenFD) n++;
+   }
+   top = used > ListenFDStart + n ? used : ListenFDStart + n;
+   for (n = i = 0; i < used; i++) {
+      if (!array[i] || array[i]->type != ListenFD) continue;
+      if ((fds[n] = fcntl(i, F_DUPFD, top)) == -1) {
+         warn("FDTable::PassListen(): fcntl(F_DUPFD)");
+         continue;
+      }
+      close(i);
+      strcpy(names + 7 * n, ((Listen *) (FD *) array[i])->binary ?
+             "binary:" : "telnet:");
+      n++;
+   }
+   used = 0;
+
+   // Only renumber onto fds nothing else is using.  If any is taken, pass
+   // nothing; the next server opens its ports itself.
+   for (i = 0; i < n; i++) {
+      if (fcntl(ListenFDStart + i, F_GETFD) != -1) {
+         errno = EBUSY;
+         warn("FDTable::PassListen(): fd #%d", ListenFDStart + i);
+         break;
+      }
+   }
+   if (i < n) {
+      for (i = 0; i < n; i++) close(fds[i]);
+      n = 0;
+   }
+   for (i = 0; i < n; i++) {
+      if (dup2(fds[i], ListenFDStart + i) == -1) {
+         warn("FDTable::PassListen(): dup2()");
+      }
+      close(fds[i]);
+   }
+   delete[] fds;
+   sprintf(buf, "%d", n);
+   setenv("LISTEN_FDS", buf, 1);
+   if (n) names[7 * n - 1] = 0;
+   setenv("LISTEN_FDNAMES", n ? names : "", 1);
+   sprintf(buf, "%d", getpid());
+   setenv("LISTEN_PID", buf, 1);
+}
+
 void FDTable::Select()			// Select across all ready connections.
 {
    fd_set rfds = readfds;		// copy of readfds to pass to select()
    fd_set wfds = writefds;		// copy of writefds to pass to select()
+   struct timeval tv;			// timeout until next timer
+   struct timeval *timeout;		// select() timeout
+   Pointer<FD> f;			// connection with deferred work
    int found;				// number of file descriptors found
 
-   found = select(size, &rfds, &wfds, NULL, NULL);
+   // Just poll if there's deferred work or output waiting.
+   timeout = Timer::Timeout(tv);
+   if (ready.Count() || flush.Count()) {
+      tv.tv_sec = tv.tv_usec = 0;
+      timeout = &tv;
+   }
+
+   found = select(size, &rfds, &wfds, NULL, timeout);
 
    if (found == -1) {
-      if (errno == EINTR) return;
-      error("FDTable::Select(): select()");
+      if (errno != EINTR) error("FDTable::Select(): select()");
+      found = 0;			// Still run timers below.
    }
 
    // Check for I/O ready on connections.
@@ -106,6 +269,22 @@ void FDTable::Select()			// Select across all ready connections.
          found--;
       }
    }
+
+   // Give each connection with deferred work one more turn, round-robin.
+   // Connections still not done go back on the end of the queue.
+   for (int n = ready.Count(); n > 0 && (f = ready.Dequeue()); n--) {
+      f->InputReady();
+   }
+
+   Timer::Run();			// Run expired timers.
+
+   // Flush phase: with all input for this pass processed, render and
+   // write new output right away, instead of waiting for select() to say
+   // so.  Whatever the kernel won't take now is left selected for writing.
+   for (int n = flush.Count(); n > 0 && (f = flush.Dequeue()); n--) {
+      f->flushing = false;
+      f->Flush();
+   }
 }
 
 void FDTable::InputReady(int fd)	// Input ready on file descriptor fd.
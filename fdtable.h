@@ -12,6 +12,7 @@
 #define _FDTABLE_H 1
 
 // Include files.
+#include "list.h"
 #include "object.h"
 #include "phoenix.h"
 
@@ -21,19 +22,32 @@ protected:
    static fd_set readfds;		// read fdset for select()
    static fd_set writefds;		// write fdset for select()
    Pointer<FD> *array;			// dynamic array of file descriptors
+   List<FD> ready;			// connections with deferred work
+   List<FD> flush;			// connections with new output
    int size;				// size of file descriptor table
    int used;				// number of file descriptors used
 public:
    FDTable();				// constructor
    ~FDTable();				// destructor
-   void OpenListen(int port);		// Open a listening port.
-   void OpenTelnet(int lfd);		// Open a telnet connection.
+   void OpenListen(int port, bool binary); // Open a listening port.
+   void OpenTelnet(int fd, struct sockaddr_in &saddr, bool binary);
+   void OpenSignal();			// Open signalfd.
+   void Adopt(FD *f);			// Add an already-open FD object.
+   void AdoptListen(int fd, bool binary); // Add an already-listening socket.
+   void Save(Handoff &h);		// Save listening sockets for handoff.
+   void Restore(Handoff &h);		// Restore listening sockets.
+   void Logins(List<Session> &list);	// Sessions still logging in.
+   void CloseOnExec();			// Close fds not handed off on exec().
    Pointer<FD> Closed(int fd);		// Close fd, return FD object pointer.
    void Close(int fd);			// Close fd, deleting FD object.
    void CloseAll();			// Close all fds.
+   void CloseConnections();		// Close all but listening sockets.
+   void PassListen();			// Pass listening sockets on exec().
    void Select();			// Select across all ready connections.
    void InputReady(int fd);		// Input ready on file descriptor fd.
    void OutputReady(int fd);		// Output ready on file descriptor fd.
+   void Defer(FD *f) { ready.Enqueue(f); } // Queue for another turn.
+   void Flush(FD *f) { flush.Enqueue(f); } // Queue for write-through.
 
    // Select fd for reading.
    void ReadSelect(int fd) {
@@ -54,6 +68,11 @@ public:
    void NoWriteSelect(int fd) {
       FD_CLR(fd, &writefds);
    }
+
+   // Is fd selected for writing?
+   bool WriteSelected(int fd) {
+      return FD_ISSET(fd, &writefds);
+   }
 };
 
 #endif // fdtable.h
@@ -0,0 +1,241 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// handoff.cc -- Handoff class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "channel.h"
+#include "fd.h"
+#include "handoff.h"
+#include "output.h"
+#include "phoenix.h"
+#include "presence.h"
+#include "resume.h"
+#include "session.h"
+
+static const char *HandoffEnv = "PHOENIX_HANDOFF"; // environment variable
+static const int HandoffMagic = 0x50584831; // "PXH1"
+static const int HandoffVersion = 13;	// state format version
+
+Handoff::Handoff()			// constructor
+{
+   buf = NULL;
+   len = allocated = pos = 0;
+   ok = true;
+}
+
+Handoff::~Handoff()			// destructor
+{
+   if (buf) delete[] buf;
+}
+
+void Handoff::Put(const void *p, int n)	// Append raw bytes.
+{
+   if (len + n > allocated) {
+      allocated = (len + n) * 2;
+      char *tmp = new char[allocated];
+      if (len) memcpy(tmp, buf, len);
+      if (buf) delete[] buf;
+      buf = tmp;
+   }
+   memcpy(buf + len, p, n);
+   len += n;
+}
+
+void Handoff::PutString(const char *s)	// Append string. (may be NULL)
+{
+   if (!s) {
+      PutInt(-1);
+      return;
+   }
+   PutInt(strlen(s));
+   Put(s, strlen(s));
+}
+
+void Handoff::PutBuffer(OutputBuffer &out) // Append output buffer contents.
+{
+   Block *block;
+   int n = 0;
+
+   for (block = out.head; block; block = block->next) {
+      n += block->free - block->data;
+   }
+   PutInt(n);
+   for (block = out.head; block; block = block->next) {
+      Put(block->data, block->free - block->data);
+   }
+}
+
+void Handoff::PutOutput(Output *out)	// Append output object.
+{
+   OutputRecord rec;
+   int n;
+
+   out->Save(rec);
+   n = rec.Size();
+   if (len + n > allocated) {
+      allocated = (len + n) * 2;
+      char *tmp = new char[allocated];
+      if (len) memcpy(tmp, buf, len);
+      if (buf) delete[] buf;
+      buf = tmp;
+   }
+   rec.Pack(buf + len);
+   len += n;
+}
+
+bool Handoff::Get(void *p, int n)	// Read raw bytes.
+{
+   if (!ok || n < 0 || pos + n > len) {
+      ok = false;
+      return false;
+   }
+   memcpy(p, buf + pos, n);
+   pos += n;
+   return true;
+}
+
+char *Handoff::GetString()		// Read new[] string. (may be NULL)
+{
+   int n = GetInt();
+   char *s;
+
+   if (n < 0 || !ok || pos + n > len) return NULL;
+   s = new char[n + 1];
+   Get(s, n);
+   s[n] = 0;
+   return s;
+}
+
+void Handoff::GetString(char *s, int size) // Read string into fixed buffer.
+{
+   char *tmp = GetString();
+
+   s[0] = 0;
+   if (!tmp) return;
+   strncpy(s, tmp, size);
+   s[size - 1] = 0;
+   delete[] tmp;
+}
+
+void Handoff::GetBuffer(OutputBuffer &out) // Read output buffer contents.
+{
+   int n = GetInt();
+
+   if (n < 0 || !ok || pos + n > len) {
+      ok = false;
+      return;
+   }
+   while (n--) out.out((unsigned char) buf[pos++]);
+}
+
+Output *Handoff::GetOutput()		// Read output object.
+{
+   OutputRecord rec;
+   int n;
+
+   if (!ok || !(n = rec.Unpack(buf + pos, len - pos))) {
+      ok = false;
+      return NULL;
+   }
+   pos += n;
+   return rec.Load();
+}
+
+int Handoff::Seal()			// Write to sealed memfd, return fd.
+{
+   int fd, n;
+
+   if ((fd = memfd_create("phoenix-handoff", MFD_ALLOW_SEALING)) == -1) {
+      return -1;
+   }
+   for (int done = 0; done < len; done += n) {
+      if ((n = write(fd, buf + done, len - done)) <= 0) {
+         close(fd);
+         return -1;
+      }
+   }
+   if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE |
+             F_SEAL_SEAL) == -1) {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+bool Handoff::Load(int fd)		// Load from sealed memfd.
+{
+   const int Seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+   struct stat st;
+   char *map;
+   int seals;
+
+   // Only trust state that can no longer change underneath us.
+   if ((seals = fcntl(fd, F_GET_SEALS)) == -1 || (seals & Seals) != Seals) {
+      return false;
+   }
+   if (fstat(fd, &st) || st.st_size <= 0) return false;
+   map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   if (map == MAP_FAILED) return false;
+   len = allocated = st.st_size;
+   buf = new char[len];
+   memcpy(buf, map, len);
+   munmap(map, st.st_size);
+   pos = 0;
+   ok = true;
+   return true;
+}
+
+int Handoff::Save()			// Save server state for exec().
+{
+   Handoff h;
+   char env[32];
+   int fd;
+
+   h.PutInt(HandoffMagic);
+   h.PutInt(HandoffVersion);
+   Presence::Flush();			// Queue any digests still collecting.
+   FD::Save(h);
+   Session::SaveAll(h);
+   Channel::Save(h);
+   Resume::Save(h);
+   FD::CloseOnExec();			// Nothing else goes to the new server.
+   if ((fd = h.Seal()) == -1) return -1;
+   sprintf(env, "%d", fd);
+   setenv(HandoffEnv, env, 1);
+   log_message("Saved %d bytes of server state for handoff.", h.len);
+   return fd;
+}
+
+void Handoff::Cancel(int fd)		// Cancel handoff if exec() failed.
+{
+   unsetenv(HandoffEnv);
+   close(fd);
+}
+
+bool Handoff::Restore()			// Restore server state, if handed off.
+{
+   const char *env = getenv(HandoffEnv);
+   Handoff h;
+   int fd;
+
+   if (!env) return false;
+   fd = atoi(env);
+   unsetenv(HandoffEnv);
+   if (!h.Load(fd)) error("Handoff::Restore(): invalid state (fd #%d)", fd);
+   close(fd);
+   if (h.GetInt() != HandoffMagic || h.GetInt() != HandoffVersion) {
+      error("Handoff::Restore(): incompatible state");
+   }
+   FD::Restore(h);
+   Session::RestoreAll(h);
+   Channel::Restore(h);
+   Resume::Restore(h);
+   if (!h.Ok()) error("Handoff::Restore(): truncated state");
+   log_message("Restored %d bytes of server state from handoff.", h.len);
+   return true;
+}
@@ -0,0 +1,69 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// handoff.h -- Handoff class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _HANDOFF_H
+#define _HANDOFF_H 1
+
+// Include files.
+#include "outbuf.h"
+#include "output.h"
+#include "phoenix.h"
+
+// Server state handed from one server binary to the next across exec().
+//
+// The listening and telnet sockets stay open across exec().  Everything
+// else needed to carry on (sessions, telnet option state, input lines and
+// pending output) is serialized into a buffer, which is written to a sealed
+// memfd whose descriptor is passed to the new binary in the environment.
+// Output objects are flattened as OutputRecords, the same as the journal.
+class Handoff {
+private:
+   char *buf;				// serialized state
+   int len;				// bytes used in buffer
+   int allocated;			// bytes allocated for buffer
+   int pos;				// read position in buffer
+   bool ok;				// no read past end of buffer?
+public:
+   Handoff();				// constructor
+   ~Handoff();				// destructor
+
+   void Put(const void *p, int n);	// Append raw bytes.
+   void PutInt(int n) { Put(&n, sizeof(n)); } // Append integer.
+   void PutLong(long long n) { Put(&n, sizeof(n)); } // Append long integer.
+   void PutString(const char *s);	// Append string. (may be NULL)
+   void PutBuffer(OutputBuffer &out);	// Append output buffer contents.
+   void PutOutput(Output *out);		// Append output object.
+
+   bool Get(void *p, int n);		// Read raw bytes.
+   int GetInt() {			// Read integer.
+      int n = 0;
+      Get(&n, sizeof(n));
+      return n;
+   }
+   long long GetLong() {		// Read long integer.
+      long long n = 0;
+      Get(&n, sizeof(n));
+      return n;
+   }
+   char *GetString();			// Read new[] string. (may be NULL)
+   void GetString(char *s, int size);	// Read string into fixed buffer.
+   void GetBuffer(OutputBuffer &out);	// Read output buffer contents.
+   Output *GetOutput();			// Read output object.
+   bool Ok() { return ok; }		// No errors reading?
+
+   int Seal();				// Write to sealed memfd, return fd.
+   bool Load(int fd);			// Load from sealed memfd.
+
+   static int Save();			// Save server state for exec().
+   static void Cancel(int fd);		// Cancel handoff if exec() failed.
+   static bool Restore();		// Restore server state, if handed off.
+};
+
+#endif // handoff.h
@@ -0,0 +1,760 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// journal.cc -- Journal and JournalReader class implementations.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "channel.h"
+#include "journal.h"
+#include "output.h"
+#include "phoenix.h"
+#include "search.h"
+#include "session.h"
+
+#include <pthread.h>
+#include <zlib.h>
+
+JournalSegment **Journal::segments;	// segments, oldest first
+int Journal::nsegments;			// number of segments
+int Journal::maxsegments;		// allocated size of segments array
+int Journal::fd = -1;			// current segment file descriptor
+int Journal::ifd = -1;			// current index file descriptor
+long Journal::size;			// size of current segment
+long long Journal::seq = 1;		// next sequence number
+char *Journal::staged;			// records staged for writing
+int Journal::nstaged;			// bytes staged
+int Journal::maxstaged;			// allocated size of staging buffer
+int Journal::unindexed;			// records since last index entry
+char *Journal::tail[JournalTailSize];	// recent packed records, a ring
+int Journal::tail_len[JournalTailSize];	// sizes of recent records
+long long Journal::tail_first = 1;	// oldest record kept in tail
+
+// Index entries of the current segment already written to the index file.
+static int indexed;
+
+// Background thread state.  The thread only does file I/O on its own file
+// descriptors; it never touches server data structures, and never logs,
+// since the logging functions are not thread-safe.
+static pthread_t worker;		// background thread
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_wake = PTHREAD_COND_INITIALIZER;
+static bool worker_running;		// background thread started?
+static bool worker_stop;		// background thread should exit?
+static int sync_fd = -1;		// (duplicate) fd waiting for fsync
+static long long cold[JournalCompressQueue]; // cold segments to compress
+static int ncold;			// count of cold segments queued
+
+// Other jobs for the background thread, run in order.
+struct JournalJob {
+   void (*func)(void *);		// function to run
+   void *arg;				// argument for function
+   JournalJob *next;			// next job
+};
+static JournalJob *jobs;		// queued jobs
+static JournalJob **jobs_tail = &jobs;	// end of job queue
+
+// Fetches for sessions, waiting on the background thread.
+static JournalFetch *fetches;		// pending fetches, oldest first
+static pthread_mutex_t fetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static FunctionTimer fetch_timer(Journal::Poll); // timer to check fetches
+
+static void CompressSegment(long long first) // Compress a cold segment.
+{
+   char path[BufSize], gzpath[BufSize], tmp[BufSize];
+   char buf[BufSize];
+   char mode[8];
+   gzFile out;
+   bool ok = true;
+   int in, n;
+
+   Journal::SegmentPath(path, first, ".log");
+   Journal::SegmentPath(gzpath, first, ".log.gz");
+   Journal::SegmentPath(tmp, first, ".log.gz.tmp");
+   if ((in = open(path, O_RDONLY)) == -1) return;
+   sprintf(mode, "wb%d", JournalCompressLevel);
+   if (!(out = gzopen(tmp, mode))) {
+      close(in);
+      return;
+   }
+   while ((n = read(in, buf, sizeof(buf))) > 0) {
+      if (gzwrite(out, buf, n) != n) {
+         ok = false;
+         break;
+      }
+   }
+   if (n < 0) ok = false;
+   if (gzclose(out) != Z_OK) ok = false;
+   close(in);
+
+   // Readers look for the plain segment first, so rename before unlinking.
+   if (ok && !rename(tmp, gzpath)) {
+      unlink(path);
+   } else {
+      unlink(tmp);
+   }
+}
+
+static void *Worker(void *arg)		// Background thread.
+{
+   JournalJob *job;
+   long long first;
+   int fd;
+
+   pthread_mutex_lock(&worker_lock);
+   while (1) {
+      while (sync_fd == -1 && !ncold && !jobs && !worker_stop) {
+         pthread_cond_wait(&worker_wake, &worker_lock);
+      }
+      if (sync_fd == -1 && ((!ncold && !jobs) || worker_stop)) break;
+      fd = sync_fd;
+      sync_fd = -1;
+      first = 0;
+      job = NULL;
+      if (!worker_stop) {
+         if (ncold) {
+            first = cold[0];
+            memmove(cold, cold + 1, --ncold * sizeof(long long));
+         } else if ((job = jobs)) {
+            if (!(jobs = job->next)) jobs_tail = &jobs;
+         }
+      }
+      pthread_mutex_unlock(&worker_lock);
+      if (fd != -1) {
+         fdatasync(fd);
+         close(fd);
+      }
+      if (first) CompressSegment(first);
+      if (job) {
+         job->func(job->arg);
+         delete job;
+      }
+      pthread_mutex_lock(&worker_lock);
+   }
+   pthread_mutex_unlock(&worker_lock);
+   return NULL;
+}
+
+static void QueueCompress(long long first) // Queue segment to compress.
+{
+   pthread_mutex_lock(&worker_lock);
+   if (ncold < JournalCompressQueue) cold[ncold++] = first;
+   pthread_cond_signal(&worker_wake);
+   pthread_mutex_unlock(&worker_lock);
+}
+
+static int CompareSeq(const void *a, const void *b) // qsort() comparison.
+{
+   long long x = *(const long long *) a, y = *(const long long *) b;
+   return x < y ? -1 : x > y;
+}
+
+JournalSegment::JournalSegment(long long seq) // constructor
+{
+   first = seq;
+   index = NULL;
+   entries = allocated = 0;
+}
+
+JournalSegment::~JournalSegment()	// destructor
+{
+   if (index) delete[] index;
+}
+
+void JournalSegment::AddIndex(long long seq, time_t time, long offset)
+{
+   if (entries >= allocated) {
+      allocated = allocated ? allocated * 2 : 64;
+      JournalIndex *tmp = new JournalIndex[allocated];
+      if (entries) memcpy(tmp, index, entries * sizeof(JournalIndex));
+      if (index) delete[] index;
+      index = tmp;
+   }
+   index[entries].seq = seq;
+   index[entries].time = time;
+   index[entries].offset = offset;
+   entries++;
+}
+
+void JournalSegment::LoadIndex()	// Load index file of segment.
+{
+   char path[BufSize];
+   JournalIndex entry;
+   int fd;
+
+   Journal::SegmentPath(path, first, ".idx");
+   if ((fd = open(path, O_RDONLY)) == -1) return;
+   while (read(fd, &entry, sizeof(entry)) == sizeof(entry)) {
+      AddIndex(entry.seq, entry.time, entry.offset);
+   }
+   close(fd);
+}
+
+// Build path name for segment file with given suffix.
+void Journal::SegmentPath(char *buf, long long first, const char *suffix)
+{
+   sprintf(buf, "%s/%012lld%s", JOURNAL_DIR, first, suffix);
+}
+
+void Journal::AddSegment(long long first) // Add segment to list.
+{
+   if (nsegments >= maxsegments) {
+      maxsegments = maxsegments ? maxsegments * 2 : 16;
+      JournalSegment **tmp = new JournalSegment *[maxsegments];
+      for (int i = 0; i < nsegments; i++) tmp[i] = segments[i];
+      if (segments) delete[] segments;
+      segments = tmp;
+   }
+   segments[nsegments++] = new JournalSegment(first);
+}
+
+void Journal::Open()			// Open journal.
+{
+   long long *found = NULL, first;
+   int nfound = 0, maxfound = 0, n;
+   struct dirent *entry;
+   DIR *dir;
+
+   if (mkdir(JOURNAL_DIR, 0700) && errno != EEXIST) {
+      error("Journal::Open(): mkdir(%s)", JOURNAL_DIR);
+   }
+   if (!(dir = opendir(JOURNAL_DIR))) {
+      error("Journal::Open(): opendir(%s)", JOURNAL_DIR);
+   }
+
+   // Find existing segments, plain or compressed.
+   while ((entry = readdir(dir))) {
+      n = -1;
+      if (sscanf(entry->d_name, "%lld.log%n", &first, &n) != 1 || n < 0) {
+         continue;
+      }
+      if (strcmp(entry->d_name + n, "") && strcmp(entry->d_name + n, ".gz")) {
+         continue;
+      }
+      if (nfound >= maxfound) {
+         maxfound = maxfound ? maxfound * 2 : 16;
+         long long *tmp = new long long[maxfound];
+         if (nfound) memcpy(tmp, found, nfound * sizeof(long long));
+         if (found) delete[] found;
+         found = tmp;
+      }
+      found[nfound++] = first;
+   }
+   closedir(dir);
+   if (nfound) qsort(found, nfound, sizeof(long long), CompareSeq);
+   for (int i = 0; i < nfound; i++) {
+      if (i && found[i] == found[i - 1]) continue; // both plain and .gz
+      AddSegment(found[i]);
+      segments[nsegments - 1]->LoadIndex();
+   }
+   if (found) delete[] found;
+
+   // Recover next sequence number from the end of the last segment.
+   if (nsegments) {
+      JournalSegment *last = segments[nsegments - 1];
+      JournalReader reader;
+
+      seq = last->first;
+      if (reader.Seek(last->entries ? last->index[last->entries - 1].seq :
+                      last->first)) {
+         while (reader.Next()) seq = reader.seq + 1;
+      }
+   }
+
+   // Load the most recent records into the in-memory tail.
+   tail_first = seq;
+   if (seq > First()) {
+      JournalReader reader;
+
+      if (reader.Seek(seq - JournalTailSize > First() ?
+                      seq - JournalTailSize : First())) {
+         while (reader.Next()) Remember(reader.seq, reader.rec);
+      }
+   }
+
+   // Start background thread.
+   worker_stop = false;
+   if (pthread_create(&worker, NULL, Worker, NULL)) {
+      error("Journal::Open(): pthread_create()");
+   }
+   worker_running = true;
+
+   // A new segment is always started, so every existing segment is cold.
+   for (int i = 0; i < nsegments; i++) {
+      char path[BufSize];
+      SegmentPath(path, segments[i]->first, ".log");
+      if (!access(path, F_OK)) QueueCompress(segments[i]->first);
+   }
+
+   log_message("Journal opened, next sequence number %lld.", seq);
+
+   Search::Open();
+}
+
+// Run function in the background thread.  It must not touch any server data
+// structures or log anything, and should not assume it will ever run, since
+// jobs still queued at shutdown are dropped.
+void Journal::Background(void (*func)(void *), void *arg)
+{
+   JournalJob *job = new JournalJob;
+
+   job->func = func;
+   job->arg = arg;
+   job->next = NULL;
+   pthread_mutex_lock(&worker_lock);
+   *jobs_tail = job;
+   jobs_tail = &job->next;
+   pthread_cond_signal(&worker_wake);
+   pthread_mutex_unlock(&worker_lock);
+}
+
+void Journal::Close()			// Flush and close journal.
+{
+   Flush();
+   Search::Close();
+   if (worker_running) {
+      pthread_mutex_lock(&worker_lock);
+      worker_stop = true;
+      pthread_cond_signal(&worker_wake);
+      pthread_mutex_unlock(&worker_lock);
+      pthread_join(worker, NULL);
+      worker_running = false;
+   }
+   if (fd != -1) {
+      fdatasync(fd);
+      close(fd);
+      fd = -1;
+   }
+   if (ifd != -1) {
+      close(ifd);
+      ifd = -1;
+   }
+
+   // Fetches still pending were dropped with the background thread's jobs.
+   while (fetches) {
+      JournalFetch *fetch = fetches;
+      fetches = fetch->next;
+      delete fetch;
+   }
+   fetch_timer.Cancel();
+}
+
+void Journal::NewSegment()		// Start a new segment.
+{
+   char path[BufSize];
+
+   if (fd != -1) {
+      Flush();
+      close(fd);
+      close(ifd);
+      QueueCompress(segments[nsegments - 1]->first);
+   }
+   AddSegment(seq);
+   SegmentPath(path, seq, ".log");
+   if ((fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600)) == -1) {
+      error("Journal::NewSegment(): open(%s)", path);
+   }
+   SegmentPath(path, seq, ".idx");
+   if ((ifd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600)) == -1) {
+      error("Journal::NewSegment(): open(%s)", path);
+   }
+   size = 0;
+   unindexed = indexed = 0;
+}
+
+void Journal::Log(Output *out)		// Append output object to journal.
+{
+   OutputRecord rec;
+   int len;
+
+   if (!out) return;
+   if (fd == -1 || size + nstaged >= JournalSegmentSize) NewSegment();
+   out->Save(rec);
+   len = sizeof(long long) + rec.Size();
+   if (nstaged + len > maxstaged) {
+      maxstaged = (nstaged + len) * 2;
+      char *tmp = new char[maxstaged];
+      if (nstaged) memcpy(tmp, staged, nstaged);
+      if (staged) delete[] staged;
+      staged = tmp;
+   }
+   if (!unindexed) {
+      segments[nsegments - 1]->AddIndex(seq, rec.time, size + nstaged);
+   }
+   if (++unindexed >= JournalIndexInterval) unindexed = 0;
+   memcpy(staged + nstaged, &seq, sizeof(long long));
+   rec.Pack(staged + nstaged + sizeof(long long));
+   nstaged += len;
+   Search::Add(seq, rec);
+   Remember(seq, rec);
+   seq++;
+}
+
+// Keep a record in the in-memory tail, replacing the oldest one.
+void Journal::Remember(long long n, OutputRecord &rec)
+{
+   int i = n % JournalTailSize;
+
+   if (tail[i]) delete[] tail[i];
+   tail_len[i] = rec.Size();
+   tail[i] = new char[tail_len[i]];
+   rec.Pack(tail[i]);
+   if (n < tail_first) tail_first = n;
+   if (n - tail_first >= JournalTailSize) tail_first = n - JournalTailSize + 1;
+}
+
+// Get a record from the in-memory tail.  The record refers into the tail,
+// so it is only valid until the next record is logged.
+bool Journal::Recent(long long n, OutputRecord &rec)
+{
+   int i = n % JournalTailSize;
+
+   if (n < tail_first || n >= seq || !tail[i]) return false;
+   return rec.Unpack(tail[i], tail_len[i]) == tail_len[i];
+}
+
+// Start fetching records for a session in the background thread.  Where to
+// start reading each stretch is worked out here, from the segment indexes.
+void Journal::Fetch(JournalFetch *fetch)
+{
+   JournalFetch **p;
+   int i;
+
+   Flush();				// Write out everything wanted.
+   fetch->last = seq - 1;
+   if (fetch->since) {
+      if (!JournalReader::LocateTime(fetch->since, fetch->segments[0],
+                                     fetch->offsets[0])) {
+         fetch->done = true;
+      }
+   } else {
+      for (i = 0; i < fetch->nseqs; i++) {
+         if (!JournalReader::Locate(fetch->seqs[i], fetch->segments[i],
+                                    fetch->offsets[i])) {
+            fetch->done = true;
+         }
+      }
+   }
+   for (p = &fetches; *p; p = &(*p)->next) ;
+   *p = fetch;
+   if (!fetch->done) Background(FetchRecords, fetch);
+   if (!fetch_timer.IsSet()) fetch_timer.SetMsec(JournalFetchPoll);
+}
+
+// Read the records wanted by a fetch.  (Background thread.)
+void Journal::FetchRecords(void *arg)
+{
+   JournalFetch *fetch = (JournalFetch *) arg;
+   JournalReader &reader = fetch->reader;
+   int i;
+
+   if (fetch->since) {
+      if (reader.Scan(fetch->segments[0], fetch->offsets[0], 0,
+                      fetch->since)) {
+         while (reader.Next() && reader.seq <= fetch->last) {
+            if (!reader.rec.VisibleTo(fetch->identity, fetch->channels)) {
+               continue;
+            }
+            if (fetch->count >= fetch->limit) {
+               fetch->more = true;
+               break;
+            }
+            fetch->Add(reader.rec);
+         }
+      }
+   } else {
+      for (i = 0; i < fetch->nseqs && fetch->count < fetch->limit; i++) {
+         if (reader.Scan(fetch->segments[i], fetch->offsets[i],
+                         fetch->seqs[i], 0) && reader.Next() &&
+             reader.seq == fetch->seqs[i] &&
+             reader.rec.VisibleTo(fetch->identity, fetch->channels)) {
+            fetch->Add(reader.rec);
+         }
+      }
+   }
+   pthread_mutex_lock(&fetch_lock);
+   fetch->done = true;
+   pthread_mutex_unlock(&fetch_lock);
+}
+
+// Hand finished fetches to their sessions, and check again later while any
+// are still pending.
+void Journal::Poll()
+{
+   JournalFetch *fetch, **p = &fetches;
+   bool done;
+
+   while ((fetch = *p)) {
+      pthread_mutex_lock(&fetch_lock);
+      done = fetch->done;
+      pthread_mutex_unlock(&fetch_lock);
+      if (!done) {
+         p = &fetch->next;
+         continue;
+      }
+      *p = fetch->next;
+      if (fetch->session->SignedOn) (fetch->session->*fetch->func)(fetch);
+      delete fetch;
+   }
+   if (fetches) fetch_timer.SetMsec(JournalFetchPoll);
+}
+
+void Journal::Flush()			// Write out staged records.
+{
+   JournalSegment *segment;
+   int n, len;
+
+   if (!nstaged || fd == -1) return;
+   for (n = 0; n < nstaged; n += len) {
+      if ((len = write(fd, staged + n, nstaged - n)) == -1) {
+         if (errno == EINTR) {
+            len = 0;
+            continue;
+         }
+         warn("Journal::Flush(): write()");
+         break;
+      }
+   }
+   size += n;				// Only count what was written.
+   nstaged = 0;
+
+   // Write out new index entries.
+   segment = segments[nsegments - 1];
+   if (indexed < segment->entries) {
+      len = (segment->entries - indexed) * sizeof(JournalIndex);
+      if (write(ifd, segment->index + indexed, len) != len) {
+         warn("Journal::Flush(): write(index)");
+      }
+      indexed = segment->entries;
+   }
+
+   // Have the background thread fsync the segment.
+   if (worker_running) {
+      pthread_mutex_lock(&worker_lock);
+      if (sync_fd == -1) sync_fd = dup(fd);
+      pthread_cond_signal(&worker_wake);
+      pthread_mutex_unlock(&worker_lock);
+   }
+}
+
+JournalReader::JournalReader()		// constructor
+{
+   firsts = NULL;
+   nsegments = 0;
+   Snapshot();
+   segment = -1;
+   file = NULL;
+   buf = NULL;
+   bufsize = 0;
+   seq = 0;
+   pending = false;
+}
+
+JournalReader::~JournalReader()		// destructor
+{
+   if (file) gzclose((gzFile) file);
+   if (buf) delete[] buf;
+   if (firsts) delete[] firsts;
+}
+
+void JournalReader::Snapshot()		// Copy the journal's segment list.
+{
+   if (firsts) delete[] firsts;
+   nsegments = Journal::nsegments;
+   firsts = new long long[nsegments ? nsegments : 1];
+   for (int i = 0; i < nsegments; i++) firsts[i] = Journal::segments[i]->first;
+}
+
+bool JournalReader::OpenSegment(int n, long offset) // Open segment at offset.
+{
+   char path[BufSize];
+
+   if (file) gzclose((gzFile) file);
+   file = NULL;
+   segment = n;
+   if (n < 0 || n >= nsegments) return false;
+
+   // Plain segments are read through zlib too, which passes them through.
+   Journal::SegmentPath(path, firsts[n], ".log");
+   if (!(file = gzopen(path, "rb"))) {
+      Journal::SegmentPath(path, firsts[n], ".log.gz");
+      if (!(file = gzopen(path, "rb"))) return false;
+   }
+   if (offset && gzseek((gzFile) file, offset, SEEK_SET) != offset) {
+      gzclose((gzFile) file);
+      file = NULL;
+      return false;
+   }
+   return true;
+}
+
+// Find segment and offset to scan from for a sequence number.  (Main thread
+// only, since it uses the segment indexes.)
+bool JournalReader::Locate(long long target, int &n, long &offset)
+{
+   JournalSegment *s;
+   int i;
+
+   for (n = Journal::nsegments - 1; n > 0; n--) {
+      if (Journal::segments[n]->first <= target) break;
+   }
+   if (n < 0) return false;
+   s = Journal::segments[n];
+   for (i = s->entries - 1; i > 0; i--) if (s->index[i].seq <= target) break;
+   offset = i >= 0 && s->entries ? s->index[i].offset : 0;
+   return true;
+}
+
+// Find segment and offset to scan from for the first record at or after a
+// time, from the last index entry before it.  (Main thread only.)
+bool JournalReader::LocateTime(time_t when, int &n, long &offset)
+{
+   JournalSegment *s;
+   int i;
+
+   for (n = Journal::nsegments - 1; n > 0; n--) {
+      s = Journal::segments[n];
+      if (s->entries && s->index[0].time < when) break;
+   }
+   if (n < 0) return false;
+   s = Journal::segments[n];
+   for (i = s->entries - 1; i > 0; i--) if (s->index[i].time < when) break;
+   offset = i >= 0 && s->entries ? s->index[i].offset : 0;
+   return true;
+}
+
+// Scan from offset in segment n to the first record at or after both target
+// and when, which Next() returns next.  A reader already in that segment
+// and short of target goes on from where it is.
+bool JournalReader::Scan(int n, long offset, long long target, time_t when)
+{
+   if (!file || n != segment || seq >= target ||
+       gztell((gzFile) file) < offset) {
+      if (!OpenSegment(n, offset)) return false;
+      pending = false;
+   }
+   while (Next()) {
+      if (seq >= target && rec.time >= when) {
+         pending = true;		// Return this record next.
+         return true;
+      }
+   }
+   return false;
+}
+
+bool JournalReader::Seek(long long target) // Seek to record by sequence number.
+{
+   long offset;
+   int n;
+
+   Journal::Flush();
+   Snapshot();
+   return Locate(target, n, offset) && Scan(n, offset, target, 0);
+}
+
+bool JournalReader::SeekTime(time_t when) // Seek to first record at/after time.
+{
+   long offset;
+   int n;
+
+   Journal::Flush();
+   Snapshot();
+   return LocateTime(when, n, offset) && Scan(n, offset, 0, when);
+}
+
+bool JournalReader::Next()		// Read next record.
+{
+   char header[sizeof(long long) + 4];
+   int len, n;
+
+   if (pending) {
+      pending = false;
+      return true;
+   }
+   while (file) {
+      // At the end of a segment (or a truncated record), go on to the next.
+      n = gzread((gzFile) file, header, sizeof(header));
+      if (n == sizeof(header)) {
+         memcpy(&seq, header, sizeof(long long));
+         memcpy(&len, header + sizeof(long long), 4);
+         if (len >= 4 && len <= JournalSegmentSize) {
+            if (len > bufsize) {
+               if (buf) delete[] buf;
+               buf = new char[bufsize = len];
+            }
+            memcpy(buf, header + sizeof(long long), 4);
+            if (gzread((gzFile) file, buf + 4, len - 4) == len - 4 &&
+                rec.Unpack(buf, len) == len) return true;
+         }
+      }
+      if (!OpenSegment(segment + 1, 0)) return false;
+   }
+   return false;
+}
+
+// Set up fetch for session s, for up to n records by sequence number.
+JournalFetch::JournalFetch(Session *s, FetchFuncPtr f, const char *a, int n):
+   session(s), func(f)
+{
+   Channel *channel;
+   char *p;
+   int len = 0;
+
+   next = NULL;
+   args = new char[strlen(a) + 1];
+   strcpy(args, a);
+   strcpy(identity, s->identity);
+
+   // Channels the session is in, for deciding what it may see.
+   for (channel = Channel::First(); channel; channel = channel->next) {
+      if (channel->members.In(s->slot)) len += strlen(channel->name) + 1;
+   }
+   p = channels = new char[len + 1];
+   for (channel = Channel::First(); channel; channel = channel->next) {
+      if (!channel->members.In(s->slot)) continue;
+      if (p > channels) *p++ = '\n';
+      strcpy(p, channel->name);
+      p += strlen(p);
+   }
+   *p = 0;
+
+   since = 0;
+   seqs = new long long[n ? n : 1];
+   segments = new int[n ? n : 1];
+   offsets = new long[n ? n : 1];
+   nseqs = 0;
+   last = 0;
+   limit = n;
+   records = NULL;
+   size = allocated = count = 0;
+   more = done = false;
+}
+
+JournalFetch::~JournalFetch()		// destructor
+{
+   delete[] args;
+   delete[] channels;
+   delete[] seqs;
+   delete[] segments;
+   delete[] offsets;
+   if (records) delete[] records;
+}
+
+void JournalFetch::Add(OutputRecord &rec) // Add record found.
+{
+   int len = rec.Size();
+
+   if (size + len > allocated) {
+      allocated = (size + len) * 2;
+      char *tmp = new char[allocated];
+      if (size) memcpy(tmp, records, size);
+      if (records) delete[] records;
+      records = tmp;
+   }
+   rec.Pack(records + size);
+   size += len;
+   count++;
+}
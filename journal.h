@@ -0,0 +1,163 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// journal.h -- Journal and JournalReader class interfaces.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _JOURNAL_H
+#define _JOURNAL_H 1
+
+// Include files.
+#include "object.h"
+#include "output.h"
+#include "phoenix.h"
+
+class JournalFetch;
+
+// Sparse index entry, one per JournalIndexInterval records.
+struct JournalIndex {
+   long long seq;			// sequence number of record
+   time_t time;				// timestamp of record
+   long offset;				// offset of record in segment
+};
+
+// Journal segment, named for the sequence number of its first record.
+class JournalSegment {
+public:
+   long long first;			// first sequence number in segment
+   JournalIndex *index;			// sparse index of segment
+   int entries;				// number of index entries
+   int allocated;			// allocated size of index
+
+   JournalSegment(long long seq);	// constructor
+   ~JournalSegment();			// destructor
+   void AddIndex(long long seq, time_t time, long offset);
+   void LoadIndex();			// Load index file of segment.
+};
+
+// Append-only message history journal.
+//
+// Every message and notification is appended to the current segment as a
+// sequence number followed by a packed OutputRecord.  Records are staged in
+// memory and written out in one batch per pass through the main loop, then
+// fsync'd by a background thread, which also compresses segments once they
+// go cold.  Each segment has a sparse index of sequence numbers, times and
+// offsets, so readers only scan a short stretch of any segment.  The most
+// recent records are also kept in memory, so /last never touches the disk,
+// and /review and /search have the background thread read the journal for
+// them (see JournalFetch).
+class Journal {
+friend class JournalReader;
+private:
+   static JournalSegment **segments;	// segments, oldest first
+   static int nsegments;		// number of segments
+   static int maxsegments;		// allocated size of segments array
+   static int fd;			// current segment file descriptor
+   static int ifd;			// current index file descriptor
+   static long size;			// size of current segment
+   static long long seq;		// next sequence number
+   static char *staged;			// records staged for writing
+   static int nstaged;			// bytes staged
+   static int maxstaged;		// allocated size of staging buffer
+   static int unindexed;		// records since last index entry
+   static char *tail[JournalTailSize];	// recent packed records, a ring
+   static int tail_len[JournalTailSize]; // sizes of recent records
+   static long long tail_first;		// oldest record kept in tail
+
+   static void NewSegment();		// Start a new segment.
+   static void AddSegment(long long first); // Add segment to list.
+   static void Remember(long long n, OutputRecord &rec); // Keep in tail.
+   static void FetchRecords(void *arg); // Run fetch in background thread.
+public:
+   static void Open();			// Open journal.
+   static void Close();			// Flush and close journal.
+   static void Log(Output *out);	// Append output object to journal.
+   static void Flush();			// Write out staged records.
+   static void Background(void (*func)(void *), void *arg); // Run in thread.
+   static long long Next() { return seq; } // Next sequence number.
+   static long long First() {		// First sequence number.
+      return nsegments ? segments[0]->first : seq;
+   }
+   static void SegmentPath(char *buf, long long first, const char *suffix);
+   static long long TailFirst() { return tail_first; } // Oldest in tail.
+   static bool Recent(long long n, OutputRecord &rec); // Record from tail.
+   static void Fetch(JournalFetch *fetch); // Start fetch in background.
+   static void Poll();			// Deliver finished fetches.
+};
+
+// Sequential reader for the journal, using a bounded amount of memory.
+//
+// A reader keeps its own list of segments, so once positioned on the main
+// thread (with Locate() or LocateTime(), which use the segment indexes), it
+// can Scan() and read in the background thread.
+class JournalReader {
+private:
+   long long *firsts;			// first sequence numbers of segments
+   int nsegments;			// number of segments
+   int segment;				// current segment number
+   void *file;				// current segment file (gzFile)
+   char *buf;				// current record buffer
+   int bufsize;				// size of record buffer
+   bool pending;			// current record not yet returned?
+
+   void Snapshot();			// Copy the journal's segment list.
+   bool OpenSegment(int n, long offset); // Open segment at offset.
+public:
+   long long seq;			// sequence number of current record
+   OutputRecord rec;			// current record
+
+   JournalReader();			// constructor
+   ~JournalReader();			// destructor
+   static bool Locate(long long target, int &n, long &offset);
+   static bool LocateTime(time_t when, int &n, long &offset);
+   bool Scan(int n, long offset, long long target, time_t when);
+   bool Seek(long long target);		// Seek to record by sequence number.
+   bool SeekTime(time_t when);		// Seek to first record at/after time.
+   bool Next();				// Read next record.
+};
+
+class Session;
+typedef void (Session::*FetchFuncPtr)(JournalFetch *fetch);
+
+// Journal records fetched by the background thread for a session, so that
+// /review and /search never read the journal on the main loop.  Records are
+// wanted either from a given time onward, or by sequence number.  Who may
+// see each record is decided from a copy of the session's identity and
+// channels, taken when the fetch starts; the records found come back packed,
+// and are handed to the session's fetch function from Journal::Poll().
+class JournalFetch {
+public:
+   // Set up on the main thread.
+   JournalFetch *next;			// next fetch pending
+   Pointer<Session> session;		// session to deliver to
+   FetchFuncPtr func;			// session function to deliver to
+   char *args;				// command arguments
+   char identity[IdentityLen];		// session identity
+   char *channels;			// session channels (newline-separated)
+   JournalReader reader;		// reader for the journal
+   time_t since;			// fetch from this time on (or 0)
+   long long *seqs;			// or fetch these records, ascending
+   int *segments;			// segment of each record (or start)
+   long *offsets;			// offset to scan from for each
+   int nseqs;				// number of records wanted
+   long long last;			// last record written when started
+   int limit;				// maximum records to fetch
+
+   // Set by the background thread.
+   char *records;			// packed records found
+   int size;				// bytes of records found
+   int allocated;			// allocated size of records
+   int count;				// number of records found
+   bool more;				// more visible records past limit?
+   bool done;				// fetch finished?
+
+   JournalFetch(Session *s, FetchFuncPtr f, const char *a, int n);
+   ~JournalFetch();			// destructor
+   void Add(OutputRecord &rec);		// Add record found.
+};
+
+#endif // journal.h
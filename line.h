@@ -20,11 +20,13 @@ class Line: public Object {
 public:
    const char *line;			// input line
    Pointer<Line> next;			// next input line
+   bool binary;				// from a binary connection?
 
-   Line(const char *p) {		// constructor
+   Line(const char *p, bool bin = false) { // constructor
       line = new char[strlen(p) + 1];
       strcpy((char *) line, p);
       next = NULL;
+      binary = bin;
    }
    ~Line() {				// destructor
       delete line;
@@ -8,25 +8,79 @@
 //
 
 // Include files.
+#include "admit.h"
 #include "fdtable.h"
 #include "listen.h"
 #include "phoenix.h"
 #include "session.h"
 #include "telnet.h"
 
-void Listen::Open(int port)
+int Listen::accepted = 0;		// connections accepted
+int Listen::failed = 0;			// accept() failures
+int Listen::deferred = 0;		// wakeups with accept budget used up
+int Listen::peak = 0;			// most connections accepted in a second
+int Listen::recent = 0;			// connections accepted this second
+time_t Listen::second = 0;		// current second for accept rate
+
+void Listen::Open(int port, bool binary)
 {
-   fdtable.OpenListen(port);
+   fdtable.OpenListen(port, binary);
 }
 
-Listen::Listen(int port)		// Listen on a port.
+// Adopt listening sockets passed by a service manager or the restart
+// supervisor (or a previous server), using the LISTEN_FDS protocol.  Any
+// socket named "binary" in LISTEN_FDNAMES speaks the binary protocol; sets
+// got_binary if there was one.
+bool Listen::Inherit(bool &got_binary)
+{
+   const char *fds = getenv("LISTEN_FDS"), *pid = getenv("LISTEN_PID");
+   const char *names = getenv("LISTEN_FDNAMES");
+   struct sockaddr_in saddr;		// socket address
+   socklen_t len;			// length of socket address
+   int n, option, found = 0;
+   bool binary;
+
+   got_binary = false;
+   if (!fds || (pid && atoi(pid) != getpid())) return false;
+   n = atoi(fds);
+   for (int fd = ListenFDStart; fd < ListenFDStart + n; fd++) {
+      binary = names && !strncmp(names, "binary", 6) &&
+         (!names[6] || names[6] == Colon);
+      if (names && (names = strchr(names, Colon))) names++;
+      len = sizeof(option);
+      if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &option, &len) ||
+          !option) {
+         warn("Listen::Inherit(): fd #%d is not a listening socket", fd);
+         continue;
+      }
+      if (fcntl(fd, F_SETFD, 0) == -1) error("Listen::Inherit(): fcntl()");
+      if (listen(fd, LISTEN_BACKLOG)) {	// Raise backlog, if need be.
+         warn("Listen::Inherit(): listen()");
+      }
+      len = sizeof(saddr);
+      if (getsockname(fd, (struct sockaddr *) &saddr, &len)) {
+         saddr.sin_port = 0;
+      }
+      log_message("Inherited %s listening socket on fd #%d, port %d.",
+                  binary ? "binary" : "telnet", fd, ntohs(saddr.sin_port));
+      fdtable.AdoptListen(fd, binary);
+      if (binary) got_binary = true;
+      found++;
+   }
+   unsetenv("LISTEN_FDS");
+   unsetenv("LISTEN_PID");
+   unsetenv("LISTEN_FDNAMES");
+   return found > 0;
+}
+
+Listen::Listen(int port, bool bin)	// Listen on a port.
 {
-   const int Backlog = 8;		// backlog on socket (for listen())
    struct sockaddr_in saddr;		// socket address
    int tries = 0;			// number of tries so far
    int option = 1;			// option to set for setsockopt()
 
    type = ListenFD;			// Identify as a Listen FD.
+   binary = bin;			// Remember protocol.
 
    // Initialize listening socket.
    memset(&saddr, 0, sizeof(saddr));
@@ -55,7 +109,52 @@ Listen::Listen(int port)		// Listen on a port.
       }
    }
 
-   if (listen(fd, Backlog)) error("Listen::Listen(): listen()");
+   if (listen(fd, LISTEN_BACKLOG)) error("Listen::Listen(): listen()");
+   NonBlocking();			// Accept until nothing is waiting.
+}
+
+// Accept pending connections, up to a budget per wakeup.  A burst of new
+// connections (each starting option negotiations) is spread across several
+// passes through the main loop, so existing connections still get serviced
+// in between; the rest just wait in the listen backlog until the next pass.
+void Listen::InputReady()
+{
+   struct sockaddr_in saddr;		// caller's address
+   socklen_t len;			// length of caller's address
+   time_t now;
+   int n, sock;
+
+   for (n = 0; fd != -1 && n < AcceptBudget; n++) {
+      len = sizeof(saddr);
+      sock = accept4(fd, (struct sockaddr *) &saddr, &len, SOCK_NONBLOCK);
+      if (sock == -1) {
+         if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+         if (errno == EINTR || errno == ECONNABORTED) continue;
+         if (!failed++) warn("Listen::InputReady(): accept4()");
+         return;			// Out of fds, most likely.
+      }
+      if (!Admission::Admit(sock, saddr.sin_addr.s_addr)) continue;
+      fdtable.OpenTelnet(sock, saddr, binary);
+
+      // Track accept rate.
+      accepted++;
+      if (time(&now) != second) {
+         if (recent > AcceptBudget) {
+            log_message("Accepted %d connections in one second.", recent);
+         }
+         second = now;
+         recent = 0;
+      }
+      if (++recent > peak) peak = recent;
+   }
+   deferred++;
+}
+
+void Listen::LogStats()			// Log accept statistics.
+{
+   log_message("Accepted %d connections, peak %d per second, budget used up "
+               "%d times, %d failures.", accepted, peak, deferred, failed);
+   Admission::LogStats();
 }
 
 Listen::~Listen()			// Listen destructor.
@@ -18,13 +18,27 @@
 
 // Listening socket (subclass of FD).
 class Listen: public FD {
+protected:
+   static int accepted;			// connections accepted
+   static int failed;			// accept() failures
+   static int deferred;			// wakeups with accept budget used up
+   static int peak;			// most connections accepted in a second
+   static int recent;			// connections accepted this second
+   static time_t second;		// current second for accept rate
 public:
-   static void Open(int port);		// Open a listening port.
-   Listen(int port);			// constructor
-   ~Listen();				// destructor
-   void InputReady() {			// Input ready on file descriptor fd.
-      if (fd != -1) fdtable.OpenTelnet(fd); // Accept pending telnet connection.
+   bool binary;				// binary protocol, not telnet?
+
+   static void Open(int port, bool binary = false); // Open a listening port.
+   static bool Inherit(bool &got_binary); // Adopt sockets from environment.
+   Listen(int port, bool bin);		// constructor
+   Listen() {				// constructor (inherited socket)
+      type = ListenFD;
+      fd = -1;
+      binary = false;
    }
+   ~Listen();				// destructor
+   static void LogStats();		// Log accept statistics.
+   void InputReady();			// Accept pending connections.
    void OutputReady() {			// Output ready on file descriptor fd.
       error("Listen::OutputReady(fd = %d): invalid operation!", fd);
    }
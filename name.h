@@ -22,7 +22,7 @@ public:
    char name[NameLen];			// Name string.
 
    // constructor
-   Name(Session *s, Name *prev, char *str): session(s) {
+   Name(Session *s, Name *prev, const char *str): session(s) {
       // Delete leading unused names. (may not work)
       while (prev && prev->References() == 1) prev = prev->next;
       strncpy(name, str, NameLen);	// Save name string.
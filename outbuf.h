@@ -20,9 +20,11 @@ class OutputBuffer {
 public:
    Block *head;				// first data block
    Block *tail;				// last data block
+   int blocks;				// number of data blocks
 
    OutputBuffer() {			// constructor
       head = tail = NULL;
+      blocks = 0;
    }
    ~OutputBuffer() {			// destructor
       Block *block;
@@ -33,6 +35,7 @@ public:
          delete block;
       }
       tail = NULL;
+      blocks = 0;
    }
    char *GetData() {			// Save buffer in string and erase.
       int len = 0;
@@ -51,6 +54,7 @@ public:
          delete block;
       }
       tail = NULL;
+      blocks = 0;
       *p = 0;
       return buf;
    }
@@ -59,9 +63,11 @@ public:
 
       if ((select = !tail)) {
          head = tail = new Block;
+         blocks++;
       } else if (tail->free >= tail->block + BlockSize) {
          tail->next = new Block;
          tail = tail->next;
+         blocks++;
       }
       *tail->free++ = byte;
       return select;
@@ -71,9 +77,11 @@ public:
 
       if ((select = !tail)) {
          head = tail = new Block;
+         blocks++;
       } else if (tail->free >= tail->block + BlockSize - 1) {
          tail->next = new Block;
          tail = tail->next;
+         blocks++;
       }
       *tail->free++ = byte1;
       *tail->free++ = byte2;
@@ -84,15 +92,39 @@ public:
 
       if ((select = !tail)) {
          head = tail = new Block;
+         blocks++;
       } else if (tail->free >= tail->block + BlockSize - 2) {
          tail->next = new Block;
          tail = tail->next;
+         blocks++;
       }
       *tail->free++ = byte1;
       *tail->free++ = byte2;
       *tail->free++ = byte3;
       return select;
    }
+   bool out(const char *buf, int len) {	// Output bytes.
+      bool select = !tail;
+      int n;
+
+      while (len > 0) {
+         if (!tail) {
+            head = tail = new Block;
+            blocks++;
+         } else if (tail->free >= tail->block + BlockSize) {
+            tail->next = new Block;
+            tail = tail->next;
+            blocks++;
+         }
+         n = tail->block + BlockSize - tail->free;
+         if (n > len) n = len;
+         memcpy(tail->free, buf, n);
+         tail->free += n;
+         buf += n;
+         len -= n;
+      }
+      return select;
+   }
 };
 
 #endif // outbuf.h
@@ -8,6 +8,7 @@
 //
 
 // Include files.
+#include "channel.h"
 #include "output.h"
 #include "phoenix.h"
 #include "session.h"
@@ -20,8 +21,15 @@ void Text::output(Telnet *telnet)
 
 void Message::output(Telnet *telnet)
 {
+   // A message reloaded from a record (after a handoff, from a spill file or
+   // the journal) knows its sender only by identity.  Find the sender's
+   // session, if still here, so the reply name resolves to it.
+   if (!from->session && from_id) {
+      from->session = Session::Identified(from_id, from->name);
+   }
    // telnet->PrintMessage(Type, time, from, to, text); XXX
-   telnet->PrintMessage(Type, time, from, text);
+   telnet->PrintMessage(Type, time, from, sendlist, text,
+                        Wrap::Find(layouts, text, telnet->width));
 }
 
 void EntryNotify::output(Telnet *telnet)
@@ -52,3 +60,352 @@ void DetachNotify::output(Telnet *telnet)
                     name->name, date(time, 11, 5));
    }
 }
+
+// Is this digest line one of the recipient's own names?
+static bool OwnName(Telnet *telnet, const char *p, const char *q)
+{
+   Name *name;
+
+   if (!telnet->session) return false;
+   for (name = telnet->session->name_obj; name; name = name->next) {
+      if (!strncmp(name->name, p, q - p) && !name->name[q - p]) return true;
+   }
+   return false;
+}
+
+// Digests go to everyone, so each recipient's own name is left out, as
+// EnqueueOthers would have done for the individual notifications.
+void PresenceDigest::output(Telnet *telnet)
+{
+   const char *p, *q, *first = NULL;
+   int i, n = 0;
+
+   for (p = names; (q = strchr(p, Newline)); p = q + 1) {
+      if (OwnName(telnet, p, q)) continue;
+      if (!n++) first = p;
+   }
+   if (!n) return;
+   switch (kind) {
+   case EntryOutput:
+      p = n == 1 ? "has entered Phoenix!" : "have entered Phoenix:";
+      break;
+   case ExitOutput:
+      p = n == 1 ? "has left Phoenix!" : "have left Phoenix:";
+      break;
+   case AttachOutput:
+      p = n == 1 ? "is now attached." : "are now attached:";
+      break;
+   default:
+      // Intentional and accidental detaches are collected together.
+      p = n == 1 ? "has detached (intentionally or accidentally)." :
+         "have detached (intentionally or accidentally):";
+      break;
+   }
+   if (n == 1) {
+      telnet->print("*** %.*s %s [%s] ***\n", (int) (strchr(first, Newline) -
+                    first), first, p, date(time, 11, 5));
+      return;
+   }
+   telnet->print("*** %d users %s ", n, p);
+   for (i = 0, p = first; i < n && i < PresenceDigestNames; p = q + 1) {
+      if (!(q = strchr(p, Newline))) break;
+      if (OwnName(telnet, p, q)) continue;
+      if (i++) telnet->output(", ");
+      telnet->output(p, q - p);
+   }
+   if (n > i) telnet->print(" and %d more", n - i);
+   telnet->print(". [%s] ***\n", date(time, 11, 5));
+}
+
+void Text::Save(OutputRecord &rec)
+{
+   Output::Save(rec);
+   rec.text = text;
+}
+
+// Copy of string, or NULL if empty.
+static char *Copy(const char *str)
+{
+   if (!str || !*str) return NULL;
+   return strcpy(new char[strlen(str) + 1], str);
+}
+
+// Keep the identities of the sender and recipients as of sending, which
+// decide who may see the message in the history, whatever names are in use
+// later.  Identities not given are taken from the sessions involved.
+void Message::Identify(const char *sender_id, const char *ids)
+{
+   if (!sender_id && from && from->session) {
+      sender_id = from->session->identity;
+   }
+   if (!ids && to) ids = to->identity;
+   from_id = Copy(sender_id);
+   to_ids = Copy(ids);
+}
+
+void Message::Save(OutputRecord &rec)
+{
+   Output::Save(rec);
+   rec.name = from->name;
+   if (from->session) rec.from = from->session->name_only;
+   if (to) rec.to = to->name_only;
+   if (sendlist) rec.to = sendlist;
+   rec.text = text;
+   rec.from_id = from_id;
+   rec.to_ids = to_ids;
+}
+
+void EntryNotify::Save(OutputRecord &rec)
+{
+   Output::Save(rec);
+   rec.name = name->name;
+}
+
+void ExitNotify::Save(OutputRecord &rec)
+{
+   Output::Save(rec);
+   rec.name = name->name;
+}
+
+void AttachNotify::Save(OutputRecord &rec)
+{
+   Output::Save(rec);
+   rec.name = name->name;
+}
+
+void DetachNotify::Save(OutputRecord &rec)
+{
+   Output::Save(rec);
+   rec.name = name->name;
+   rec.flags = intentional;
+}
+
+void PresenceDigest::Save(OutputRecord &rec)
+{
+   Output::Save(rec);
+   rec.flags = kind;
+   rec.text = names;
+}
+
+// Packed records are a fixed header (total length, type, flags, timestamp)
+// followed by the name, sender, recipient and text as null-terminated strings.
+// The journal and handoff use the host's own layout, and add the sender's
+// and recipients' identities; records journaled before identities were kept
+// end after the text.  The binary protocol uses a fixed network order header
+// (a 4-byte length and an 8-byte timestamp, both big-endian) and leaves out
+// the identities.
+static const int RecordHeader = 8 + sizeof(time_t);
+static const int WireHeader = 16;
+
+// Size of the strings of a record, with or without identities.
+static int StringsSize(OutputRecord &rec, bool ids)
+{
+   int size = (rec.name ? strlen(rec.name) : 0) +
+      (rec.from ? strlen(rec.from) : 0) + (rec.to ? strlen(rec.to) : 0) +
+      (rec.text ? strlen(rec.text) : 0) + 4;
+
+   if (ids) {
+      size += (rec.from_id ? strlen(rec.from_id) : 0) +
+         (rec.to_ids ? strlen(rec.to_ids) : 0) + 2;
+   }
+   return size;
+}
+
+// Pack one string into buffer, return the end.
+static char *PackString(char *buf, const char *str)
+{
+   strcpy(buf, str ? str : "");
+   return buf + strlen(buf) + 1;
+}
+
+// Pack the strings of a record into buffer, with or without identities.
+static void PackStrings(char *buf, OutputRecord &rec, bool ids)
+{
+   buf = PackString(buf, rec.name);
+   buf = PackString(buf, rec.from);
+   buf = PackString(buf, rec.to);
+   buf = PackString(buf, rec.text);
+   if (ids) {
+      buf = PackString(buf, rec.from_id);
+      PackString(buf, rec.to_ids);
+   }
+}
+
+// Unpack one string, or return NULL if it isn't terminated before end.
+static const char *UnpackString(const char *&p, const char *end)
+{
+   const char *str = p;
+
+   while (p < end && *p) p++;
+   if (p++ >= end) return NULL;
+   return str;
+}
+
+// Unpack the strings of a record, which must end exactly at end.
+static bool UnpackStrings(const char *p, const char *end, OutputRecord &rec,
+                          bool ids)
+{
+   rec.from_id = rec.to_ids = NULL;
+   if (!(rec.name = UnpackString(p, end)) ||
+       !(rec.from = UnpackString(p, end)) ||
+       !(rec.to = UnpackString(p, end)) ||
+       !(rec.text = UnpackString(p, end))) return false;
+   if (p == end) return true;
+   if (!ids || !(rec.from_id = UnpackString(p, end)) ||
+       !(rec.to_ids = UnpackString(p, end))) return false;
+   if (!*rec.from_id) rec.from_id = NULL;
+   if (!*rec.to_ids) rec.to_ids = NULL;
+   return p == end;
+}
+
+int OutputRecord::Size()		// Size of packed record.
+{
+   return RecordHeader + StringsSize(*this, true);
+}
+
+void OutputRecord::Pack(char *buf)	// Pack record into buffer.
+{
+   int len = Size();
+
+   memcpy(buf, &len, 4);
+   buf[4] = type;
+   buf[5] = flags;
+   buf[6] = buf[7] = 0;
+   memcpy(buf + 8, &time, sizeof(time_t));
+   PackStrings(buf + RecordHeader, *this, true);
+}
+
+// Unpack record from buffer, return size (0 if invalid or incomplete).
+// The string pointers refer into the buffer, which must stay valid.
+int OutputRecord::Unpack(const char *buf, int len)
+{
+   int size;
+
+   if (len < RecordHeader) return 0;
+   memcpy(&size, buf, 4);
+   if (size < RecordHeader + 4 || size > len) return 0;
+   type = OutputType(buf[4]);
+   flags = buf[5];
+   memcpy(&time, buf + 8, sizeof(time_t));
+   return UnpackStrings(buf + RecordHeader, buf + size, *this, true) ? size : 0;
+}
+
+int OutputRecord::WireSize()		// Size of record in network order.
+{
+   return WireHeader + StringsSize(*this, false);
+}
+
+void OutputRecord::PackWire(char *buf)	// Pack record in network order.
+{
+   unsigned long long t = time;
+   unsigned int len = WireSize();
+   int i;
+
+   for (i = 0; i < 4; i++) buf[i] = len >> (24 - 8 * i);
+   buf[4] = type;
+   buf[5] = flags;
+   buf[6] = buf[7] = 0;
+   for (i = 0; i < 8; i++) buf[8 + i] = t >> (56 - 8 * i);
+   PackStrings(buf + WireHeader, *this, false);
+}
+
+// Unpack network order record from buffer, return size (0 if invalid or
+// incomplete).  The string pointers refer into the buffer.
+int OutputRecord::UnpackWire(const char *buf, int len)
+{
+   const unsigned char *p = (const unsigned char *) buf;
+   unsigned long long t = 0;
+   int size, i;
+
+   if (len < WireHeader) return 0;
+   size = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+   if (size < WireHeader + 4 || size > len) return 0;
+   type = OutputType(buf[4]);
+   flags = buf[5];
+   for (i = 0; i < 8; i++) t = (t << 8) | p[8 + i];
+   time = (time_t) t;
+   return UnpackStrings(buf + WireHeader, buf + size, *this, false) ? size : 0;
+}
+
+Output *OutputRecord::Load()		// Create new Output object from record.
+{
+   char *buf;
+
+   switch (type) {
+   case TextOutput:
+      buf = new char[strlen(text) + 1];
+      strcpy(buf, text);
+      return new Text(buf, time);
+   case PublicMessage:
+   case PrivateMessage:
+   case ChannelMessage:
+      return new Message(type, new Name(NULL, NULL, name), to, text, time,
+                         from_id, to_ids);
+   case EntryOutput:
+      return new EntryNotify(new Name(NULL, NULL, name), time);
+   case ExitOutput:
+      return new ExitNotify(new Name(NULL, NULL, name), time);
+   case AttachOutput:
+      return new AttachNotify(new Name(NULL, NULL, name), time);
+   case DetachOutput:
+      return new DetachNotify(new Name(NULL, NULL, name), flags, time);
+   case PresenceOutput:
+      buf = new char[strlen(text) + 1];
+      strcpy(buf, text);
+      return new PresenceDigest(OutputType(flags), buf, time);
+   default:
+      return NULL;
+   }
+}
+
+// Is name in a newline-separated list of names?
+static bool InList(const char *list, const char *name)
+{
+   int len = strlen(name);
+
+   if (!len) return false;
+   while (list) {
+      if (!strncasecmp(list, name, len) && (!list[len] || list[len] == '\n')) {
+         return true;
+      }
+      if ((list = strchr(list, '\n'))) list++;
+   }
+   return false;
+}
+
+bool OutputRecord::VisibleTo(Session *session) // Is record visible to session?
+{
+   Channel *channel;
+
+   // Private messages are only visible to the sender and the recipients,
+   // and channel messages to the sender and current channel members.  The
+   // sender and recipients are known by identity, never by name.
+   switch (type) {
+   case PrivateMessage:
+      return (from_id && !strcasecmp(from_id, session->identity)) ||
+         (to_ids && InList(to_ids, session->identity));
+   case ChannelMessage:
+      return (from_id && !strcasecmp(from_id, session->identity)) ||
+         (to && (channel = Channel::Find(to)) &&
+          channel->members.In(session->slot));
+   default:
+      return true;
+   }
+}
+
+// Is record visible to identity, a member of the (newline-separated) channels
+// given?  Unlike the above, this doesn't look at sessions or channels, so the
+// journal's background thread can use it.
+bool OutputRecord::VisibleTo(const char *identity, const char *channels)
+{
+   switch (type) {
+   case PrivateMessage:
+      return (from_id && !strcasecmp(from_id, identity)) ||
+         (to_ids && InList(to_ids, identity));
+   case ChannelMessage:
+      return (from_id && !strcasecmp(from_id, identity)) ||
+         (to && InList(channels, to));
+   default:
+      return true;
+   }
+}
@@ -15,16 +15,48 @@
 #include "name.h"
 #include "object.h"
 #include "phoenix.h"
+#include "wrap.h"
 
 // Types of Output subclasses.
 enum OutputType {
    UnknownOutput, TextOutput, PublicMessage, PrivateMessage, EntryOutput,
-   ExitOutput, AttachOutput, DetachOutput
+   ExitOutput, AttachOutput, DetachOutput, PromptOutput, PresenceOutput,
+   ChannelMessage
 };
 
 // Classifications of Output subclasses.
 enum OutputClass {UnknownClass, TextClass, MessageClass, NotificationClass};
 
+// Flattened form of an Output object, for saving outside of memory.
+class OutputRecord {
+public:
+   OutputType type;			// Output type.
+   time_t time;				// Timestamp.
+   int flags;				// Type-specific flags.
+   const char *name;			// Name involved, if any.
+   const char *from;			// Sender's plain name, if any.
+   const char *to;			// Recipient's plain name, if any.
+   const char *text;			// Text, if any.
+   const char *from_id;			// Sender's identity, if any.
+   const char *to_ids;			// Recipients' identities, if any.
+
+   OutputRecord() {			// constructor
+      type = UnknownOutput;
+      time = 0;
+      flags = 0;
+      name = from = to = text = from_id = to_ids = NULL;
+   }
+   int Size();				// Size of packed record.
+   void Pack(char *buf);		// Pack record into buffer.
+   int Unpack(const char *buf, int len); // Unpack record, return size.
+   int WireSize();			// Size of record in network order.
+   void PackWire(char *buf);		// Pack record in network order.
+   int UnpackWire(const char *buf, int len); // Unpack network order record.
+   Output *Load();			// Create new Output object from record.
+   bool VisibleTo(Session *session);	// Is record visible to session?
+   bool VisibleTo(const char *identity, const char *channels);
+};
+
 class Output: public Object {
 public:
    OutputType Type;			// Output type.
@@ -41,15 +73,21 @@ public:
    }
    virtual ~Output() {}			// destructor
    virtual void output(Telnet *telnet) = 0;
+   virtual void Save(OutputRecord &rec) { // Save object to record.
+      rec.type = Type;
+      rec.time = time;
+   }
 };
 
 class Text: public Output {
 protected:
    const char *text;
 public:
-   Text(const char *buf): Output(TextOutput, TextClass), text(buf) { }
+   Text(const char *buf, time_t when = 0):
+      Output(TextOutput, TextClass, when), text(buf) { }
    ~Text() { delete[] text; }
    void output(Telnet *telnet);
+   void Save(OutputRecord &rec);
 };
 
 class Message: public Output {
@@ -57,16 +95,46 @@ protected:
    Pointer<Name> from;
    Pointer<Session> to;
    // Pointer<Sendlist> to;
+   const char *sendlist;		// channel, or names (newline-separated)
    const char *text;
+   char *from_id;			// sender's identity, if known
+   char *to_ids;			// recipients' identities (newline-separated)
+   Wrap *layouts;			// word wrap layouts, by screen width
+
+   void Identify(const char *sender_id, const char *ids);
 public:
    Message(OutputType type, Name *sender, Session *destination,
-           const char *msg):
-      Output(type, MessageClass), from(sender), to(destination) {
+           const char *msg, time_t when = 0):
+      Output(type, MessageClass, when), from(sender), to(destination) {
+      sendlist = NULL;
       text = new char[strlen(msg) + 1];
       strcpy((char *) text, msg);
+      layouts = NULL;
+      Identify(NULL, NULL);
+   }
+   Message(OutputType type, Name *sender, const char *list, const char *msg,
+           time_t when = 0, const char *sender_id = NULL,
+           const char *ids = NULL):
+      Output(type, MessageClass, when), from(sender) {
+      sendlist = NULL;
+      if (list) {
+         sendlist = new char[strlen(list) + 1];
+         strcpy((char *) sendlist, list);
+      }
+      text = new char[strlen(msg) + 1];
+      strcpy((char *) text, msg);
+      layouts = NULL;
+      Identify(sender_id, ids);
+   }
+   ~Message() {
+      if (sendlist) delete[] sendlist;
+      delete text;
+      if (from_id) delete[] from_id;
+      if (to_ids) delete[] to_ids;
+      if (layouts) delete layouts;
    }
-   ~Message() { delete text; }
    void output(Telnet *telnet);
+   void Save(OutputRecord &rec);
 };
 
 class EntryNotify: public Output {
@@ -76,6 +144,7 @@ public:
    EntryNotify(Name *who, time_t when = 0):
       Output(EntryOutput, NotificationClass, when), name(who) { }
    void output(Telnet *telnet);
+   void Save(OutputRecord &rec);
 };
 
 class ExitNotify: public Output {
@@ -85,6 +154,7 @@ public:
    ExitNotify(Name *who, time_t when = 0):
       Output(ExitOutput, NotificationClass, when), name(who) { }
    void output(Telnet *telnet);
+   void Save(OutputRecord &rec);
 };
 
 class AttachNotify: public Output {
@@ -94,6 +164,7 @@ public:
    AttachNotify(Name *who, time_t when = 0):
       Output(AttachOutput, NotificationClass, when), name(who) { }
    void output(Telnet *telnet);
+   void Save(OutputRecord &rec);
 };
 
 class DetachNotify: public Output {
@@ -105,6 +176,21 @@ public:
       Output(DetachOutput, NotificationClass, when), name(who), intentional(i) {
    }
    void output(Telnet *telnet);
+   void Save(OutputRecord &rec);
+};
+
+// Digest of presence notifications of one kind, sent during storms.
+class PresenceDigest: public Output {
+protected:
+   OutputType kind;			// kind of notifications
+   const char *names;			// names, one per line
+public:
+   PresenceDigest(OutputType k, const char *list, time_t when = 0):
+      Output(PresenceOutput, NotificationClass, when), kind(k), names(list) {
+   }
+   ~PresenceDigest() { delete[] names; }
+   void output(Telnet *telnet);
+   void Save(OutputRecord &rec);
 };
 
 #endif // output.h
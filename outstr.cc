@@ -8,26 +8,106 @@
 //
 
 // Include files.
+#include "handoff.h"
 #include "outstr.h"
 #include "phoenix.h"
 #include "session.h"
+#include "spill.h"
 #include "telnet.h"
 
+// Spilled output logically follows the "spilled" object (or precedes the
+// head of the queue if that is NULL).  Only unsent output is ever spilled,
+// and output is never sent past that point while any spilled output remains
+// unread, so the original ordering is always preserved.
+
+OutputStream::~OutputStream()		// destructor
+{
+   while (head) {			// Free any remaining output in queue.
+      OutputObject *out = head;
+      head = out->next;
+      delete out;
+   }
+   tail = spilled = NULL;
+   count = 0;
+   if (spill) delete spill;
+   spill = NULL;
+}
+
+OutputStream::OutputObject::~OutputObject() // destructor
+{
+   Rendering *r;
+
+   while ((r = rendered)) {		// Free any renderings.
+      rendered = r->next;
+      delete r;
+   }
+}
+
+// With several connections attached, each object is rendered only once for
+// each kind of connection and screen width, and the rendered bytes copied to
+// the other connections alike, instead of formatting it over and over.
 void OutputStream::OutputObject::output(Telnet *telnet) // Output object.
 {
-   OutputObj->output(telnet);
+   Session *session = telnet->session;
+   OutputBuffer &out = telnet->Output;
+   Block *head, *tail, *block;
+   Rendering *r;
+   char *text, *p;
+   int blocks, len = 0;
+
+   if (!session || !session->telnet || !session->telnet->also) {
+      telnet->Send(OutputObj);		// Only connection, nothing to share.
+      telnet->TimingMark();
+      return;
+   }
+   for (r = rendered; r; r = r->next) {
+      if (r->type == telnet->type && r->width == telnet->width) break;
+   }
+   if (!r) {
+      // Render into an empty output buffer, then take the result.
+      head = out.head;
+      tail = out.tail;
+      blocks = out.blocks;
+      out.head = out.tail = NULL;
+      out.blocks = 0;
+      telnet->Send(OutputObj);
+      for (block = out.head; block; block = block->next) {
+         len += block->free - block->data;
+      }
+      p = text = new char[len];
+      while ((block = out.head)) {
+         memcpy(p, block->data, block->free - block->data);
+         p += block->free - block->data;
+         out.head = block->next;
+         delete block;
+      }
+      out.head = head;
+      out.tail = tail;
+      out.blocks = blocks;
+      r = rendered = new Rendering(telnet->type, telnet->width, text, len,
+                                   rendered);
+   }
+   if (out.out(r->text, r->len) && !telnet->blocked) telnet->WriteSelect();
    telnet->TimingMark();
 }
 
-void OutputStream::Attach(Telnet *telnet) // Review detached output.
+void OutputStream::Attach(Telnet *telnet) // Review output not yet dequeued.
 {
-   sent = NULL;
-   Acknowledged = Sent = 0;
-   while (telnet && telnet->acknowledge && SendNext(telnet)) ;
+   if (!telnet) return;
+   telnet->sent = NULL;
+   telnet->Acknowledged = telnet->Sent = 0;
+   if (telnet->acknowledge) {
+      while (SendNext(telnet)) ;
+   } else {
+      telnet->Dirty();			// Faked acknowledgements, in flush phase.
+   }
 }
 
-void OutputStream::Enqueue(Telnet *telnet, Output *out) // Enqueue output.
+// Enqueue output for all connections in list.
+void OutputStream::Enqueue(Telnet *list, Output *out)
 {
+   Telnet *telnet;
+
    if (!out) return;
    if (tail) {
       tail->next = new OutputObject(out);
@@ -35,38 +115,196 @@ void OutputStream::Enqueue(Telnet *telnet, Output *out) // Enqueue output.
    } else {
       head = tail = new OutputObject(out);
    }
-   if (telnet && telnet->acknowledge) while (SendNext(telnet)) ;
+   count++;
+   for (telnet = list; telnet; telnet = telnet->also) {
+      telnet->Dirty();			// Render in flush phase.
+      if (count - telnet->Acknowledged > PendingLimit) { // Not keeping up.
+         telnet->SlowReader();
+         SpillOutput(list);
+         if (Backlog(telnet) > OutputDetachLimit &&
+             !telnet->overflow.IsSet()) {
+            telnet->overflow.SetMsec(0);
+         }
+      }
+   }
+   if (!list && count > PendingLimit) {
+      SpillOutput(list);		// Keep detached sessions bounded.
+   }
+}
+
+void OutputStream::Acknowledge(Telnet *telnet) // Acknowledge output object.
+{
+   if (telnet->Acknowledged < telnet->Sent) telnet->Acknowledged++;
 }
 
-void OutputStream::Dequeue()		// Dequeue all acknowledged output.
+int OutputStream::Backlog(Telnet *telnet) // Count of unacknowledged output.
+{
+   return count - telnet->Acknowledged + (spill ? spill->Count() : 0);
+}
+
+// Dequeue all output acknowledged by every connection in list.
+void OutputStream::Dequeue(Telnet *list)
 {
    OutputObject *out;
+   Telnet *telnet;
+   int n = -1;
 
-   if (Acknowledged) {
-      while (Acknowledged && Sent && (out = head)) {
-         Acknowledged--;
-         Sent--;
-         head = out->next;
-         delete out;
-      }
-      if (!head) {
-         sent = tail = NULL;
-         Acknowledged = Sent = 0;
-      }
+   for (telnet = list; telnet; telnet = telnet->also) {
+      if (n < 0 || telnet->Acknowledged < n) n = telnet->Acknowledged;
+   }
+   if (n <= 0) return;
+   for (telnet = list; telnet; telnet = telnet->also) {
+      telnet->Acknowledged -= n;
+      if (!(telnet->Sent -= n)) telnet->sent = NULL;
+   }
+   while (n-- && (out = head)) {
+      count--;
+      head = out->next;
+      if (spilled == out) spilled = NULL;
+      delete out;
+   }
+   if (!head) {
+      tail = spilled = NULL;
+      count = 0;
    }
 }
 
 bool OutputStream::SendNext(Telnet *telnet) // Send next output object.
 {
-   if (!telnet || (!sent && !head)) return false;
-   if (sent && !sent->next) {
+   if (!telnet) return false;
+   // Above the high mark, hold output objects here (spilling them to disk
+   // if need be) instead of formatting them into ever more output blocks.
+   if (telnet->Output.blocks >= OutputHighMark) {
+      telnet->held = true;
+      return false;
+   }
+   if (spill && spill->Count() && telnet->sent == spilled) Unspill();
+   if (!telnet->sent && !head) return false;
+   if (telnet->sent && !telnet->sent->next) {
       telnet->RedrawInput();
       return false;
    } else {
-      sent = sent ? sent->next : head;
+      telnet->sent = telnet->sent ? telnet->sent->next : head;
       telnet->UndrawInput();
-      sent->output(telnet);
-      Sent++;
+      telnet->sent->output(telnet);
+      telnet->Sent++;
    }
    return true;
 }
+
+// Spill older unsent output to disk, for all connections in list.
+void OutputStream::SpillOutput(Telnet *list)
+{
+   OutputObject *out;
+   Telnet *telnet;
+   int n = 0;
+
+   if (!spill) spill = new Spill;
+   if (!spill->Count()) {		// Spill starts after all sent output.
+      spilled = NULL;
+      for (telnet = list; telnet; telnet = telnet->also) {
+         if (telnet->Sent > n) {
+            n = telnet->Sent;
+            spilled = telnet->sent;
+         }
+      }
+   }
+
+   // Spill down to half the limit, so spilling happens in batches.
+   while (count > PendingLimit / 2) {
+      out = spilled ? spilled->next : head;
+      if (!out || !spill->Write(out->OutputObj)) break;
+      if (spilled) {
+         spilled->next = out->next;
+      } else {
+         head = out->next;
+      }
+      if (tail == out) tail = spilled;
+      count--;
+      delete out;
+   }
+   spill->Flush();
+}
+
+void OutputStream::Unspill()		// Reload a batch of spilled output.
+{
+   OutputObject *out;
+   Output *obj;
+
+   for (int i = 0; i < SpillBatch && (obj = spill->Read()); i++) {
+      out = new OutputObject(obj);
+      if (spilled) {
+         out->next = spilled->next;
+         spilled->next = out;
+      } else {
+         out->next = head;
+         head = out;
+      }
+      if (tail == spilled) tail = out;
+      spilled = out;
+      count++;
+   }
+}
+
+void OutputStream::Save(Handoff &h)	// Save output stream for handoff.
+{
+   OutputObject *out;
+   int n = 0;
+
+   // Bring any spilled output back into memory first.
+   while (spill && spill->Count()) {
+      n = count;
+      Unspill();
+      if (count == n) break;		// Unreadable spill file.
+   }
+   n = 0;
+   if (spill) delete spill;
+   spill = NULL;
+   spilled = NULL;
+
+   for (out = head; out; out = out->next) n++;
+   h.PutInt(n);
+   for (out = head; out; out = out->next) h.PutOutput(out->OutputObj);
+}
+
+void OutputStream::Restore(Handoff &h)	// Restore output stream from handoff.
+{
+   int n = h.GetInt();
+   Output *obj;
+
+   for (int j = 0; j < n && (obj = h.GetOutput()); j++) {
+      if (tail) {
+         tail->next = new OutputObject(obj);
+         tail = tail->next;
+      } else {
+         head = tail = new OutputObject(obj);
+      }
+      count++;
+   }
+}
+
+// Save connection's place in output stream for handoff.
+void OutputStream::SaveCursor(Handoff &h, Telnet *telnet)
+{
+   OutputObject *out;
+   int i = -1, n = 0;
+
+   for (out = head; out; out = out->next, n++) {
+      if (out == telnet->sent) i = n;
+   }
+   h.PutInt(i);
+   h.PutInt(telnet->Acknowledged);
+   h.PutInt(telnet->Sent);
+}
+
+// Restore connection's place in output stream from handoff.
+void OutputStream::RestoreCursor(Handoff &h, Telnet *telnet)
+{
+   OutputObject *out;
+   int i = h.GetInt();
+
+   telnet->Acknowledged = h.GetInt();
+   telnet->Sent = h.GetInt();
+   for (out = head; out && i > 0; out = out->next) i--;
+   telnet->sent = i ? NULL : out;
+}
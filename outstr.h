@@ -15,44 +15,69 @@
 #include "output.h"
 #include "phoenix.h"
 
+// Output stream for a session, shared by all of its connections.  Each
+// connection keeps its own place in the stream (sent object and counts of
+// sent and acknowledged objects); objects are dequeued once acknowledged
+// by every connection attached.
 class OutputStream {
-private:
+public:
+   class Rendering {			// Object as rendered for a connection.
+   public:
+      Rendering *next;			// next rendering
+      int type;				// connection type
+      int width;			// screen width
+      char *text;			// rendered output
+      int len;				// length of rendered output
+
+      Rendering(int t, int w, char *buf, int n, Rendering *list) {
+         type = t;
+         width = w;
+         text = buf;
+         len = n;
+         next = list;
+      }
+      ~Rendering() { delete[] text; }
+   };
+
    class OutputObject {
    public:
       OutputObject *next;
       Pointer<Output> OutputObj;
+      Rendering *rendered;		// renderings shared by connections
 
       // constructor
-      OutputObject(Output *out): OutputObj(out) { next = NULL; }
+      OutputObject(Output *out): OutputObj(out) {
+         next = NULL;
+         rendered = NULL;
+      }
+      ~OutputObject();			// destructor
       void output(Telnet *telnet);
    };
-public:
+
    OutputObject *head;			// first output object
-   OutputObject *sent;			// next output object to send
    OutputObject *tail;			// last output object
-   int Acknowledged;			// count of acknowledged queue objects
-   int Sent;				// count of sent queue objects
+   OutputObject *spilled;		// object spilled output follows
+   Spill *spill;			// spill file for detached output
+   int count;				// count of output objects in memory
 
    OutputStream() {			// constructor
-      head = sent = tail = NULL;
-      Acknowledged = Sent = 0;
-   }
-   ~OutputStream() {			// destructor
-      while (head) {			// Free any remaining output in queue.
-         OutputObject *out = head;
-         head = out->next;
-         delete out;
-      }
-      sent = tail = NULL;
-      Acknowledged = Sent = 0;
-   }
-   void Acknowledge() {			// Acknowledge a block of output.
-      if (Acknowledged < Sent) Acknowledged++;
+      head = tail = spilled = NULL;
+      spill = NULL;
+      count = 0;
    }
+   ~OutputStream();			// destructor
+   void Acknowledge(Telnet *telnet);	// Acknowledge a block of output.
+   int Backlog(Telnet *telnet);		// Count of unacknowledged output.
    void Attach(Telnet *telnet);
-   void Enqueue(Telnet *telnet, Output *out);
-   void Dequeue();
+   void Enqueue(Telnet *list, Output *out);
+   void Dequeue(Telnet *list);
    bool SendNext(Telnet *telnet);
+   void SpillOutput(Telnet *list);	// Spill older unsent output to disk.
+   void Unspill();			// Reload a batch of spilled output.
+   void Save(Handoff &h);		// Save output stream for handoff.
+   void Restore(Handoff &h);		// Restore output stream from handoff.
+   void SaveCursor(Handoff &h, Telnet *telnet); // Save connection's place.
+   void RestoreCursor(Handoff &h, Telnet *telnet); // Restore connection's.
 };
 
 #endif // outstr.h
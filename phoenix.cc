@@ -11,15 +11,24 @@
 #include "block.h"
 #include "fd.h"
 #include "fdtable.h"
+#include "handoff.h"
+#include "journal.h"
 #include "listen.h"
 #include "phoenix.h"
+#include "presence.h"
+#include "search.h"
 #include "session.h"
+#include "sigfd.h"
 #include "telnet.h"
+#include "timer.h"
 #include "user.h"
 
 // Global variables.
 int Shutdown;				// shutdown flag
+bool Upgrade;				// upgrade requested?
 FILE *logfile;				// log file
+FunctionTimer ShutdownTimer(ShutdownTimeout); // shutdown countdown timer
+FunctionTimer StatsTimer(StatsTimeout);	// periodic statistics timer
 
 // XXX Should logfile use non-blocking code instead?
 
@@ -55,6 +64,14 @@ void OpenLog()				// open log file
    fprintf(stderr, "Logging on \"%s\".\n", buf);
 }
 
+void ReopenLog()			// received SIGHUP
+{
+   log_message("Reopening log file.");
+   if (logfile) fclose(logfile);
+   OpenLog();
+   log_message("Log file reopened.");
+}
+
 // XXX Use << operator instead of printf() formats?
 void log_message(const char *format, ...) // log message
 {
@@ -78,12 +95,16 @@ void warn(const char *format, ...)	// print error message
    va_end(ap);
    if (errno >= 0 && errno < sys_nerr) {
       (void) fprintf(stderr, "\n%s: %s\n", buf, sys_errlist[errno]);
-      (void) fprintf(logfile, "[%s] %s: %s\n", date(0, 4, 15), buf,
-                     sys_errlist[errno]);
+      if (logfile) {
+         (void) fprintf(logfile, "[%s] %s: %s\n", date(0, 4, 15), buf,
+                        sys_errlist[errno]);
+      }
    } else {
       (void) fprintf(stderr, "\n%s: Error %d\n", buf, errno);
-      (void) fprintf(logfile, "[%s] %s: Error %d\n", date(0, 4, 15), buf,
-                     errno);
+      if (logfile) {
+         (void) fprintf(logfile, "[%s] %s: Error %d\n", date(0, 4, 15),
+                        buf, errno);
+      }
    }
 }
 
@@ -97,12 +118,16 @@ void error(const char *format, ...)	// print error message and exit
    va_end(ap);
    if (errno >= 0 && errno < sys_nerr) {
       (void) fprintf(stderr, "\n%s: %s\n", buf, sys_errlist[errno]);
-      (void) fprintf(logfile, "[%s] %s: %s\n", date(0, 4, 15), buf,
-                     sys_errlist[errno]);
+      if (logfile) {
+         (void) fprintf(logfile, "[%s] %s: %s\n", date(0, 4, 15), buf,
+                        sys_errlist[errno]);
+      }
    } else {
       (void) fprintf(stderr, "\n%s: Error %d\n", buf, errno);
-      (void) fprintf(logfile, "[%s] %s: Error %d\n", date(0, 4, 15), buf,
-                     errno);
+      if (logfile) {
+         (void) fprintf(logfile, "[%s] %s: Error %d\n", date(0, 4, 15),
+                        buf, errno);
+      }
    }
    if (logfile) fclose(logfile);
    exit(1);
@@ -134,7 +159,7 @@ const char *message_start(const char *line, char *sendlist, int len,
    // Attempt to detect smileys that shouldn't be sendlists...
    if (!isalpha(*line) && !isspace(*line)) {
       /* Only compare initial non-whitespace characters. */
-      for (i = 0; i < len; i++) if (isspace(line[i])) break;
+      for (i = 0; i < len && line[i]; i++) if (isspace(line[i])) break;
 
       // Just special-case a few smileys...
       if (!strncmp(line, ":-)", i) || !strncmp(line, ":-(", i) ||
@@ -208,16 +233,17 @@ int match_name(const char *name, const char *sendlist)
    return 0;
 }
 
-void quit(int sig)			// received SIGQUIT or SIGTERM
+void Quit()				// received SIGQUIT or SIGTERM
 {
+   if (Shutdown == 1 || Shutdown == 2) return;
    log_message("Shutdown requested by signal in 30 seconds.");
    Session::announce("\a\a>>> This server will shutdown in 30 seconds... <<<"
                     "\n\a\a");
-   alarm(30);
+   ShutdownTimer.Set(30);
    Shutdown = 1;
 }
 
-void alrm(int sig)			// received SIGALRM
+void ShutdownTimeout()			// Next step of shutdown countdown.
 {
    // Ignore unless shutting down.
    switch (Shutdown) {
@@ -225,7 +251,7 @@ void alrm(int sig)			// received SIGALRM
       log_message("Final shutdown warning.");
       Session::announce("\a\a>>> Server shutting down NOW!  Goodbye. <<<\n"
                         "\a\a");
-      alarm(5);
+      ShutdownTimer.Set(5);
       Shutdown++;
       break;
    case 2:
@@ -233,7 +259,7 @@ void alrm(int sig)			// received SIGALRM
    case 3:
       log_message("Final restart warning.");
       Session::announce("\a\a>>> Server restarting NOW!  Goodbye. <<<\n\a\a");
-      alarm(5);
+      ShutdownTimer.Set(5);
       Shutdown++;
       break;
     case 4:
@@ -241,18 +267,75 @@ void alrm(int sig)			// received SIGALRM
    }
 }
 
+void LogStats()				// Log statistics.
+{
+   Listen::LogStats();
+   Telnet::LogStats();
+   Presence::LogStats();
+}
+
+void StatsTimeout()			// Log periodic statistics.
+{
+   log_message("Periodic statistics:");
+   LogStats();
+   StatsTimer.Set(StatsInterval);
+}
+
+void SetSignals()			// Set signal handling for server.
+{
+#ifdef USE_SIGIGNORE
+   sigignore(SIGINT);
+   sigignore(SIGPIPE);
+#else
+   signal(SIGINT, SIG_IGN);
+   signal(SIGPIPE, SIG_IGN);
+#endif
+   Signal::Open();			// SIGHUP, SIGQUIT, SIGTERM, SIGUSR1.
+}
+
 void RestartServer()			// Restart server.
 {
    log_message("Restarting server.");
+   LogStats();
+   FD::CloseConnections();		// Closing sessions may still log.
+   Journal::Close();
    if (logfile) fclose(logfile);
-   FD::CloseAll();
+   logfile = NULL;
+   FD::PassListen();			// Keep listening through the restart.
    execl("conf", "conf", NULL);
    error("conf");
 }
 
+void UpgradeServer()			// Restart server, keeping connections.
+{
+   int fd, err;
+
+   log_message("Upgrading server.");
+   LogStats();
+   if ((fd = Handoff::Save()) == -1) {
+      warn("UpgradeServer(): Handoff::Save()");
+      Session::announce("*** Server upgrade failed. ***\n");
+      return;
+   }
+   Journal::Close();
+   if (logfile) fclose(logfile);
+   execl("conf", "conf", NULL);
+
+   // Still here, so carry on with the old server.
+   err = errno;
+   OpenLog();
+   Journal::Open();
+   Handoff::Cancel(fd);
+   errno = err;
+   warn("UpgradeServer(): conf");
+   Session::announce("*** Server upgrade failed. ***\n");
+}
+
 void ShutdownServer()			// Shutdown server.
 {
    log_message("Server down.");
+   LogStats();
+   Journal::Close();
    if (logfile) fclose(logfile);
    exit(0);
 }
@@ -261,31 +344,42 @@ int main(int argc, char **argv)		// main program
 {
    int pid;				// server process number
    int port;				// TCP port to use
+   int binary_port;			// TCP port for binary protocol
+   bool handoff;			// handed off by previous server?
+   bool inherited;			// listening sockets inherited?
+   bool got_binary;			// binary listening socket inherited?
 
    Shutdown = 0;
    if (chdir(HOME)) error(HOME);
    OpenLog();
    port = argc > 1 ? atoi(argv[1]) : 0;
    if (!port) port = DefaultPort;
-   Listen::Open(port);
+   binary_port = argc > 2 ? atoi(argv[2]) : DefaultBinaryPort;
+
+   // Take over connections from the previous server, if upgrading, or
+   // listening sockets from a supervisor, otherwise open the ports.  Open
+   // the binary port if a supervisor didn't pass it.
+   handoff = Handoff::Restore();
+   inherited = !handoff && Listen::Inherit(got_binary);
+   if (!handoff && !inherited) {
+      Listen::Open(port);
+      if (binary_port) Listen::Open(binary_port, true);
+   } else if (inherited && !got_binary && binary_port) {
+      Listen::Open(binary_port, true);
+   }
 
-   // fork subprocess and exit parent
-   if (argc < 2 || strcmp(argv[1], "-debug")) {
+   // fork subprocess and exit parent, unless started by a supervisor
+   if (handoff) {
+      SetSignals();
+      log_message("Server upgraded, running as pid %d.", getpid());
+   } else if (inherited) {
+      SetSignals();
+      log_message("Server started on inherited sockets. (pid %d)", getpid());
+   } else if (argc < 2 || strcmp(argv[1], "-debug")) {
       switch (pid = fork()) {
       case 0:
          setsid();
-#ifdef USE_SIGIGNORE
-         sigignore(SIGHUP);
-         sigignore(SIGINT);
-         sigignore(SIGPIPE);
-#else
-         signal(SIGHUP, SIG_IGN);
-         signal(SIGINT, SIG_IGN);
-         signal(SIGPIPE, SIG_IGN);
-#endif
-         signal(SIGQUIT, quit);
-         signal(SIGTERM, quit);
-         signal(SIGALRM, alrm);
+         SetSignals();
          log_message("Server started, running on port %d. (pid %d)", port,
                      getpid());
          break;
@@ -303,8 +397,14 @@ int main(int argc, char **argv)		// main program
                   getpid());
    }
 
+   // Open journal after forking, since the journal has its own thread.
+   Journal::Open();
+   StatsTimer.Set(StatsInterval);
+
    while(1) {
       Session::CheckShutdown();
       FD::Select();
+      Journal::Flush();
+      Search::Poll();
    }
 }
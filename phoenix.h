@@ -15,8 +15,10 @@
 extern "C" {
 #include <arpa/inet.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <memory.h>
 #include <netinet/in.h>
 #include <signal.h>
@@ -27,10 +29,15 @@ extern "C" {
 #include <string.h>
 #include <strings.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
 #include <sys/select.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 };
@@ -45,6 +52,21 @@ extern "C" {
 #define HOME "/usr/local/lib/phoenix"
 #endif
 
+// Backlog for listening sockets.  (capped by net.core.somaxconn)
+#ifndef LISTEN_BACKLOG
+#define LISTEN_BACKLOG 1024
+#endif
+
+// Directory for spill files, relative to home directory.
+#ifndef SPILL_DIR
+#define SPILL_DIR "spool"
+#endif
+
+// Directory for message history journal, relative to home directory.
+#ifndef JOURNAL_DIR
+#define JOURNAL_DIR "journal"
+#endif
+
 // For compatibility.
 #ifndef EWOULDBLOCK
 #define EWOULDBLOCK EAGAIN
@@ -63,9 +85,66 @@ const char *strerror(int err)
 const int BlockSize = 1024;		// data size for block
 const int BufSize = 32768;		// general temporary buffer size
 const int InputSize = 256;		// default size of input line buffer
+const int SubnegotiationSize = 64;	// longest telnet subnegotiation kept
+const int DefaultWidth = 80;		// screen width until client tells us
+const int DefaultHeight = 24;		// screen height until client tells us
+const int MinWidth = 20;		// narrowest screen width used
+const int MinHeight = 4;		// shortest screen height used
+const int CompressLevel = 6;		// zlib level for MCCP2 output
+const int CompressWindowBits = 12;	// zlib window (log2) for MCCP2 output
+const int CompressMemLevel = 5;		// zlib memory level for MCCP2 output
 const int NameLen = 33;			// maximum length of name (with null)
-const int SendlistLen = 33;		// maximum length of sendlist (w/null)
+const int SendlistLen = 256;		// maximum length of sendlist (w/null)
+const int IdentityLen = 40;		// maximum length of identity (w/null)
+const int SendlistNames = 16;		// maximum names in one sendlist
 const int DefaultPort = 6789;		// TCP port to run on
+const int DefaultBinaryPort = 6790;	// TCP port for binary protocol (0 = none)
+const int BinaryRecordSize = 4096;	// longest binary record accepted
+const int ListenFDStart = 3;		// first socket passed in LISTEN_FDS
+const int AcceptBudget = 32;		// connections accepted per wakeup
+const int ReadBudget = 4096;		// input bytes read per turn
+const int LineBudget = 8;		// input lines processed per turn
+const int WriteBudget = 16384;		// output bytes written per turn
+const int WriteVectors = 16;		// output blocks written at once
+const int FloodBurst = 10;		// input lines allowed in a burst
+const int FloodInterval = 500;		// milliseconds per input line after
+const int FloodQueueMax = 50;		// input lines held before discarding
+const int BotFloodBurst = 100;		// binary input records in a burst
+const int BotFloodInterval = 20;	// milliseconds per binary record after
+const int TimerTick = 100;		// timer resolution in milliseconds
+const int TimerSlots = 64;		// slots per timer wheel level
+const int TimerLevels = 4;		// timer wheel levels
+const int LoginTimeout = 300;		// seconds to finish logging in
+const int IdleTimeout = 0;		// seconds idle to detach (0 = never)
+const int StatsInterval = 3600;		// seconds between statistics logs
+const int AdmitTableSize = 4096;	// hosts tracked for admission control
+const int AdmitProbes = 16;		// admission table slots searched
+const int AdmitMaxConns = 8;		// concurrent connections per host
+const int AdmitBurst = 10;		// connects per host in a burst
+const int AdmitInterval = 6;		// seconds per connect after a burst
+const int PresenceBurst = 10;		// presence notices sent before digests
+const int PresenceWindow = 2000;	// milliseconds between presence digests
+const int PresenceDigestNames = 10;	// names listed in a presence digest
+const int ResumeTableSize = 1024;	// resume token hash buckets
+const int ResumeTokenLen = 32;		// hex digits in a resume token
+const int PendingLimit = 256;		// detached output kept in memory
+const int SpillBatch = 32;		// spilled output reloaded at once
+const int OutputHighMark = 64;		// output blocks queued before holding
+const int OutputLowMark = 16;		// output blocks queued before resuming
+const int OutputDetachLimit = 4096;	// unread output before detaching
+const int JournalSegmentSize = 1 << 20;	// journal segment size to start anew
+const int JournalIndexInterval = 64;	// journal records per index entry
+const int JournalCompressLevel = 6;	// zlib level for cold journal segments
+const int JournalCompressQueue = 64;	// cold segments queued to compress
+const int ReviewLimit = 500;		// maximum records for /review and /last
+const int JournalTailSize = 2048;	// recent journal records kept for /last
+const int JournalFetchPoll = 20;	// msec between checks on journal fetches
+const int SearchWordLen = 32;		// longest word indexed for /search
+const int SearchBuckets = 4096;		// in-memory search index hash buckets
+const int SearchRunPostings = 65536;	// postings per search index run file
+const int SearchMergeRuns = 4;		// search index runs before merging
+const int SearchQueryWords = 8;		// maximum words in a /search query
+const int SearchLimit = 20;		// maximum /search results shown
 
 // Boolean type.
 #ifdef NO_BOOLEAN
@@ -90,12 +169,18 @@ enum Char {
 class Block;
 class FD;
 class FDTable;
+class FunctionTimer;
+class Handoff;
 class Line;
 class Listen;
+class Output;
 class OutputBuffer;
 class Session;
+class Signal;
+class Spill;
 class Telnet;
 class User;
+class Wrap;
 
 // Input function pointer type.
 typedef void (Session::*InputFuncPtr)(const char *line);
@@ -106,6 +191,7 @@ typedef void (Telnet::*CallbackFuncPtr)();
 // Function prototypes.
 const char *date(time_t clock, int start, int len);
 void OpenLog();
+void ReopenLog();
 void log_message(const char *format, ...);
 void warn(const char *format, ...);
 void error(const char *format, ...);
@@ -113,14 +199,21 @@ void crash(const char *format, ...);
 const char *message_start(const char *line, char *sendlist, int len,
                           bool &is_explicit);
 int match_name(const char *name, const char *sendlist);
-void quit(int sig);
-void alrm(int sig);
+void Quit();
+void ShutdownTimeout();
+void LogStats();
+void StatsTimeout();
+void SetSignals();
 void RestartServer();
+void UpgradeServer();
 void ShutdownServer();
 int main(int argc, char **argv);
 
 // Global variables.
 extern int Shutdown;			// shutdown flag
+extern bool Upgrade;			// upgrade requested?
 extern FILE *logfile;			// log file
+extern FunctionTimer ShutdownTimer;	// shutdown countdown timer
+extern FunctionTimer StatsTimer;	// periodic statistics timer
 
 #endif // phoenix.h
@@ -0,0 +1,96 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// presence.cc -- Presence class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "presence.h"
+#include "phoenix.h"
+#include "session.h"
+
+OutputBuffer Presence::names[Kinds];	// names collected, one per line
+int Presence::count[Kinds];		// count of names collected
+long long Presence::stamp = 0;		// tick current window started
+int Presence::seen = 0;			// notifications in current window
+bool Presence::collecting = false;	// collecting notifications?
+int Presence::collected = 0;		// notifications collected (statistics)
+int Presence::digests = 0;		// digests sent (statistics)
+FunctionTimer Presence::timer(Presence::Flush); // digest timer
+
+// Notification types collected, in digest order.
+static const OutputType Types[] = {
+   EntryOutput, AttachOutput, DetachOutput, ExitOutput
+};
+
+int Presence::Kind(OutputType type)	// Index for notification type.
+{
+   for (int i = 0; i < Kinds; i++) {
+      if (Types[i] == type) return i;
+   }
+   return -1;
+}
+
+// Collect presence notification for the next digest, if notifications are
+// arriving too fast.  Returns false if it should go out by itself.
+bool Presence::Collect(Output *out)
+{
+   long long now = Timer::Now();
+   OutputRecord rec;
+   int i;
+
+   if ((i = Kind(out->Type)) < 0) return false;
+   if (!collecting) {
+      if ((now - stamp) * TimerTick >= PresenceWindow) {
+         stamp = now;			// Start a new window.
+         seen = 0;
+      }
+      if (++seen <= PresenceBurst) return false;
+      log_message("Presence storm, sending digests.");
+      collecting = true;
+      timer.SetMsec(PresenceWindow);
+   }
+   out->Save(rec);
+   names[i].out(rec.name, strlen(rec.name));
+   names[i].out(Newline);
+   count[i]++;
+   collected++;
+   return true;
+}
+
+// Send each kind of notification collected to everyone as one digest, or
+// stop collecting if there were none this time.
+void Presence::Flush()
+{
+   bool any = false;
+   char *list;
+
+   if (!collecting) return;
+   for (int i = 0; i < Kinds; i++) {
+      if (!count[i]) continue;
+      if ((list = names[i].GetData())) {
+         Session::EnqueueAll(new PresenceDigest(Types[i], list));
+         digests++;
+      }
+      count[i] = 0;
+      any = true;
+   }
+   if (any) {
+      timer.SetMsec(PresenceWindow);	// Storm may not be over yet.
+   } else {
+      log_message("Presence storm over.");
+      collecting = false;
+      stamp = Timer::Now();
+      seen = 0;
+      timer.Cancel();
+   }
+}
+
+void Presence::LogStats()		// Log presence digest statistics.
+{
+   log_message("Presence notifications: %d collected into %d digests.",
+               collected, digests);
+}
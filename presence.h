@@ -0,0 +1,48 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// presence.h -- Presence class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _PRESENCE_H
+#define _PRESENCE_H 1
+
+// Include files.
+#include "outbuf.h"
+#include "output.h"
+#include "phoenix.h"
+#include "timer.h"
+
+// Coalescing of presence notifications (entry, exit, attach and detach)
+// during storms.  Normally each goes to everyone as it happens, but after a
+// restart or a network partition, hundreds of users coming and going at once
+// means an object and an output line per user for every recipient.  Once
+// more than PresenceBurst arrive within PresenceWindow, further ones are
+// only journaled and collected, and each PresenceWindow, everything of a
+// kind collected goes to everyone as one PresenceDigest, which leaves out
+// each recipient's own name.  Detaches are collected together, intentional
+// or not.  Collecting stops after a quiet window.
+class Presence {
+private:
+   static const int Kinds = 4;		// kinds of notifications collected
+   static OutputBuffer names[Kinds];	// names collected, one per line
+   static int count[Kinds];		// count of names collected
+   static long long stamp;		// tick current window started
+   static int seen;			// notifications in current window
+   static bool collecting;		// collecting notifications?
+   static int collected;		// notifications collected (statistics)
+   static int digests;			// digests sent (statistics)
+   static FunctionTimer timer;		// digest timer
+
+   static int Kind(OutputType type);	// Index for notification type.
+public:
+   static bool Collect(Output *out);	// Collect notification, if storming.
+   static void Flush();			// Send digests of collected notices.
+   static void LogStats();		// Log presence digest statistics.
+};
+
+#endif // presence.h
@@ -1,5 +1,6 @@
 /*
- * Utility program to restart conferencing server from cron.
+ * Utility program to restart conferencing server from cron, or to supervise
+ * it with a persistent listening socket.
  *
  * restart.c -- restart code.
  *
@@ -12,11 +13,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 /* Location of server binary. */
@@ -29,6 +33,24 @@
 #define PORT 6789
 #endif
 
+/* TCP port for the server's binary protocol (0 = none). */
+#ifndef BINARY_PORT
+#define BINARY_PORT 6790
+#endif
+
+/* Backlog on listening socket held by supervisor. */
+#ifndef BACKLOG
+#define BACKLOG 128
+#endif
+
+/* Minimum seconds between server restarts by supervisor. */
+#ifndef RESTART_DELAY
+#define RESTART_DELAY 5
+#endif
+
+/* First file descriptor passed to server (LISTEN_FDS protocol). */
+#define LISTEN_FD 3
+
 int check_for_server(int port)		/* check for running server */
 {
    struct sockaddr_in saddr;		/* socket address */
@@ -53,11 +75,105 @@ int check_for_server(int port)		/* check for running server */
    return 0;
 }
 
+int open_listener(int port, int target) /* open listening socket */
+{
+   struct sockaddr_in saddr;		/* socket address */
+   int fd;				/* listening socket fd */
+   int option = 1;			/* option to set for setsockopt() */
+
+   memset(&saddr, 0, sizeof(saddr));
+   saddr.sin_family = AF_INET;
+   saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+   saddr.sin_port = htons((u_short) port);
+   if ((fd = socket(PF_INET, SOCK_STREAM, 0)) == -1) return -1;
+   if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option)) ||
+       bind(fd, (struct sockaddr *) &saddr, sizeof(saddr)) ||
+       listen(fd, BACKLOG)) {
+      close(fd);
+      return -1;
+   }
+
+   /* Move socket to where the server expects it. */
+   if (fd != target) {
+      if (dup2(fd, target) == -1) {
+         close(fd);
+         return -1;
+      }
+      close(fd);
+   }
+   return target;
+}
+
+/*
+ * Supervise the server: hold the listening sockets (telnet, then binary) open
+ * and start the server with them, again whenever the server dies.
+ * Connections arriving while the server is down wait in the backlog instead
+ * of being refused.  Returns when the server exits normally (shutdown).
+ */
+int supervise(int port, int binary_port)
+{
+   char buf[32];			/* environment value buffer */
+   time_t started;			/* time server was last started */
+   int status;				/* server exit status */
+   int binary = 0;			/* passing binary listener too? */
+   pid_t pid;				/* server process id */
+
+   if (open_listener(port, LISTEN_FD) == -1) {
+      fprintf(stderr, "restart: port %d: %s\n", port, strerror(errno));
+      return 1;
+   }
+   if (binary_port) {
+      if (open_listener(binary_port, LISTEN_FD + 1) == -1) {
+         fprintf(stderr, "restart: port %d: %s\n", binary_port,
+                 strerror(errno));
+      } else {
+         binary = 1;
+      }
+   }
+   signal(SIGHUP, SIG_IGN);
+   signal(SIGINT, SIG_IGN);
+   signal(SIGPIPE, SIG_IGN);
+
+   while (1) {
+      time(&started);
+      switch (pid = fork()) {
+      case -1:
+         fprintf(stderr, "restart: fork: %s\n", strerror(errno));
+         break;
+      case 0:
+         sprintf(buf, "%d", (int) getpid());
+         setenv("LISTEN_PID", buf, 1);
+         setenv("LISTEN_FDS", binary ? "2" : "1", 1);
+         setenv("LISTEN_FDNAMES", binary ? "telnet:binary" : "telnet", 1);
+         execl(SERVER_PATH, SERVER_PATH, NULL);
+         fprintf(stderr, "%s: %s\n", SERVER_PATH, strerror(errno));
+         _exit(1);
+      default:
+         while (waitpid(pid, &status, 0) == -1 && errno == EINTR) ;
+         if (WIFEXITED(status) && !WEXITSTATUS(status)) return 0;
+         if (WIFSIGNALED(status)) {
+            fprintf(stderr, "restart: server killed by signal %d\n",
+                    WTERMSIG(status));
+         } else {
+            fprintf(stderr, "restart: server exited with status %d\n",
+                    WEXITSTATUS(status));
+         }
+         break;
+      }
+
+      /* Don't restart a crashing server too quickly. */
+      if (time(NULL) - started < RESTART_DELAY) sleep(RESTART_DELAY);
+   }
+}
+
 int main(int argc, char **argv)		/* main program */
 {
    /* If the server is already running, silently exit. */
    if (check_for_server(PORT)) exit(0);
 
+   /* Supervise the server if requested. */
+   if (argc > 1 && !strcmp(argv[1], "-supervise")) exit(supervise(PORT, BINARY_PORT));
+
    /* Restart the server. */
    execl(SERVER_PATH, SERVER_PATH, NULL);
 
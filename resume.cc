@@ -0,0 +1,165 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// resume.cc -- Resume class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "handoff.h"
+#include "phoenix.h"
+#include "resume.h"
+#include "session.h"
+
+ResumeToken *Resume::table[ResumeTableSize]; // hash table of tokens
+unsigned char Resume::key[16];		// hash key
+bool Resume::keyed = false;		// hash key chosen?
+
+static const char HexDigits[] = "0123456789abcdef";
+
+void Resume::Random(unsigned char *buf, int len) // Get random bytes.
+{
+   int n;
+
+   while (len > 0) {
+      if ((n = getrandom(buf, len, 0)) == -1) {
+         if (errno == EINTR) continue;
+         error("Resume::Random(): getrandom()");
+      }
+      buf += n;
+      len -= n;
+   }
+}
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND do { \
+   v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+   v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+   v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+   v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+} while (0)
+
+// Keyed hash of buffer. (SipHash-2-4)
+unsigned long long Resume::Hash(const unsigned char *buf, int len)
+{
+   unsigned long long k0 = 0, k1 = 0, m, b = (unsigned long long) len << 56;
+   unsigned long long v0, v1, v2, v3;
+   int i;
+
+   for (i = 7; i >= 0; i--) {
+      k0 = k0 << 8 | key[i];
+      k1 = k1 << 8 | key[i + 8];
+   }
+   v0 = k0 ^ 0x736f6d6570736575ULL;
+   v1 = k1 ^ 0x646f72616e646f6dULL;
+   v2 = k0 ^ 0x6c7967656e657261ULL;
+   v3 = k1 ^ 0x7465646279746573ULL;
+   for (; len >= 8; buf += 8, len -= 8) {
+      for (m = 0, i = 7; i >= 0; i--) m = m << 8 | buf[i];
+      v3 ^= m;
+      SIPROUND;
+      SIPROUND;
+      v0 ^= m;
+   }
+   for (i = len - 1; i >= 0; i--) b |= (unsigned long long) buf[i] << (8 * i);
+   v3 ^= b;
+   SIPROUND;
+   SIPROUND;
+   v0 ^= b;
+   v2 ^= 0xff;
+   SIPROUND;
+   SIPROUND;
+   SIPROUND;
+   SIPROUND;
+   return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Issue a new token for session, returning it as hex digits.
+const char *Resume::Issue(Session *session)
+{
+   static char token[ResumeTokenLen + 1];
+   unsigned char buf[ResumeTokenLen / 2];
+   unsigned long long hash;
+   int i;
+
+   if (!keyed) {
+      Random(key, sizeof(key));
+      keyed = true;
+   }
+   Revoke(session);
+   do {
+      Random(buf, sizeof(buf));
+   } while (!(hash = Hash(buf, sizeof(buf))));
+   for (i = 0; i < (int) sizeof(buf); i++) {
+      token[2 * i] = HexDigits[buf[i] >> 4];
+      token[2 * i + 1] = HexDigits[buf[i] & 15];
+   }
+   token[ResumeTokenLen] = 0;
+   Add(session, hash);
+   return token;
+}
+
+// Add token hash for session. (also used for handoff)
+void Resume::Add(Session *session, unsigned long long hash)
+{
+   ResumeToken *t = new ResumeToken;
+   int i = hash & (ResumeTableSize - 1);
+
+   t->hash = hash;
+   t->session = session;
+   t->next = table[i];
+   table[i] = t;
+   session->resume = hash;
+}
+
+Session *Resume::Find(const char *token) // Find session for token.
+{
+   unsigned char buf[ResumeTokenLen / 2];
+   unsigned long long hash;
+   const char *p;
+   ResumeToken *t;
+   int i, n;
+
+   if (!keyed || strlen(token) != ResumeTokenLen) return NULL;
+   for (i = 0; i < ResumeTokenLen; i++) {
+      if (!(p = strchr(HexDigits, tolower(token[i]))) || !*p) return NULL;
+      n = p - HexDigits;
+      buf[i / 2] = i & 1 ? buf[i / 2] | n : n << 4;
+   }
+   hash = Hash(buf, sizeof(buf));
+   for (t = table[hash & (ResumeTableSize - 1)]; t; t = t->next) {
+      if (t->hash == hash) return t->session;
+   }
+   return NULL;
+}
+
+void Resume::Revoke(Session *session)	// Revoke session's token.
+{
+   ResumeToken *t, **p;
+
+   if (!session->resume) return;
+   p = &table[session->resume & (ResumeTableSize - 1)];
+   while ((t = *p)) {
+      if (t->session == session) {
+         *p = t->next;
+         delete t;
+         break;
+      }
+      p = &t->next;
+   }
+   session->resume = 0;
+}
+
+void Resume::Save(Handoff &h)		// Save hash key for handoff.
+{
+   h.PutInt(keyed);
+   h.Put(key, sizeof(key));
+}
+
+void Resume::Restore(Handoff &h)	// Restore hash key from handoff.
+{
+   keyed = h.GetInt();
+   h.Get(key, sizeof(key));
+}
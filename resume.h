@@ -0,0 +1,48 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// resume.h -- Resume class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _RESUME_H
+#define _RESUME_H 1
+
+// Include files.
+#include "phoenix.h"
+
+// Resume token for one session.
+struct ResumeToken {
+   ResumeToken *next;			// next token in hash chain
+   unsigned long long hash;		// keyed hash of token
+   Session *session;			// session to resume
+};
+
+// Resume tokens let a client get back into its session after losing its
+// connection, without logging in again.  Each session is issued a random
+// token at sign-on, which the client can present at the login prompt, or
+// as the RESUME variable in telnet NEW-ENVIRON negotiation.  Only a keyed
+// hash of each token is kept (SipHash-2-4, under a random key chosen at
+// startup), so resuming costs one short hash and a table lookup instead of
+// crypt().  A session's token is revoked when the session is closed.
+class Resume {
+private:
+   static ResumeToken *table[ResumeTableSize]; // hash table of tokens
+   static unsigned char key[16];	// hash key
+   static bool keyed;			// hash key chosen?
+
+   static unsigned long long Hash(const unsigned char *buf, int len);
+public:
+   static void Random(unsigned char *buf, int len); // Get random bytes.
+   static const char *Issue(Session *session); // Issue token for session.
+   static void Add(Session *session, unsigned long long hash); // Add hash.
+   static Session *Find(const char *token); // Find session for token.
+   static void Revoke(Session *session); // Revoke session's token.
+   static void Save(Handoff &h);	// Save hash key for handoff.
+   static void Restore(Handoff &h);	// Restore hash key from handoff.
+};
+
+#endif // resume.h
@@ -0,0 +1,745 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// search.cc -- Search class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "channel.h"
+#include "journal.h"
+#include "output.h"
+#include "phoenix.h"
+#include "search.h"
+#include "session.h"
+
+#include <pthread.h>
+
+SearchTerm **Search::buckets;		// in-memory index hash table
+int Search::postings;			// postings in in-memory index
+long long Search::first;		// first sequence number in memory
+long long Search::last;			// last sequence number indexed
+SearchRun **Search::runs;		// mapped runs, oldest first
+int Search::nruns;			// number of runs
+bool Search::merging;			// merge in progress?
+
+// Background merge of the oldest runs into one.  The merged run replaces
+// the first (oldest) run file; the others are removed once it's mapped.
+struct SearchMerge {
+   int n;				// number of runs to merge
+   long long *firsts;			// first sequence numbers of runs
+   bool done;				// merge finished?
+   bool ok;				// merge succeeded?
+};
+static SearchMerge *merge;		// merge in progress, if any
+static pthread_mutex_t merge_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Visibility terms start with a character NextWord() never returns.  Every
+// private or channel message is posted under Restricted, and under sender
+// and recipient identities (never names, which anyone can take) and channel
+// names, case-folded.
+static const char Restricted[] = "\001";
+static const char SenderTerm = 'f';	// "\001f<identity>": sent by
+static const char RecipientTerm = 't';	// "\001t<identity>": sent to
+static const char ChannelTerm = 'c';	// "\001c<name>": sent to channel
+static const int TermLen = IdentityLen > NameLen ? IdentityLen : NameLen;
+
+// Cursor over a delta-encoded posting list.
+class PostingCursor {
+public:
+   const unsigned char *p;		// next byte of posting list
+   const unsigned char *end;		// end of posting list
+   long long seq;			// current sequence number
+
+   PostingCursor(): p(NULL), end(NULL), seq(0) { }
+   void Set(const unsigned char *start, int len) {
+      p = start;
+      end = start + len;
+      seq = 0;
+   }
+   bool Next() {			// Decode next sequence number.
+      long long delta = 0;
+      int shift = 0;
+
+      if (p >= end) return false;
+      while (p < end && *p & 0x80) {
+         delta |= (long long) (*p++ & 0x7f) << shift;
+         shift += 7;
+      }
+      if (p >= end) return false;
+      delta |= (long long) *p++ << shift;
+      seq += delta;
+      return true;
+   }
+   bool Seek(long long target) {	// Advance to target, true if present.
+      while (seq < target && Next()) ;
+      return seq == target;
+   }
+};
+
+// Build case-folded visibility term for identity or channel name.
+static const char *VisibilityTerm(char *buf, char kind, const char *name,
+                                  int len)
+{
+   int i;
+
+   buf[0] = Restricted[0];
+   buf[1] = kind;
+   for (i = 0; i < len && name[i] && i < TermLen - 1; i++) {
+      buf[i + 2] = tolower(name[i]);
+   }
+   buf[i + 2] = 0;
+   return buf;
+}
+
+// Encode a delta as a variable-length number, return length.
+static int Encode(unsigned char *buf, long long delta)
+{
+   int n = 0;
+
+   while (delta >= 0x80) {
+      buf[n++] = (delta & 0x7f) | 0x80;
+      delta >>= 7;
+   }
+   buf[n++] = delta;
+   return n;
+}
+
+// Extract next case-folded word from text, return NULL if none left.
+static const char *NextWord(const char *p, char *word)
+{
+   int len;
+
+   while (1) {
+      while (*p && !isalnum(*p)) p++;
+      if (!*p) return NULL;
+      for (len = 0; isalnum(*p); p++) {
+         if (len < SearchWordLen - 1) word[len++] = tolower(*p);
+      }
+      word[len] = 0;
+      if (len > 1) return p;		// Skip single characters.
+   }
+}
+
+static unsigned int Hash(const char *word) // Hash word for in-memory index.
+{
+   unsigned int hash = 2166136261u;
+
+   while (*word) hash = (hash ^ (unsigned char) *word++) * 16777619u;
+   return hash & (SearchBuckets - 1);
+}
+
+static int CompareTerms(const void *a, const void *b) // qsort() comparison.
+{
+   return strcmp((*(SearchTerm **) a)->word, (*(SearchTerm **) b)->word);
+}
+
+SearchTerm::SearchTerm(const char *w)	// constructor
+{
+   word = new char[strlen(w) + 1];
+   strcpy(word, w);
+   postings = NULL;
+   length = allocated = count = 0;
+   last = 0;
+   next = NULL;
+}
+
+SearchTerm::~SearchTerm()		// destructor
+{
+   delete[] word;
+   if (postings) delete[] postings;
+}
+
+void SearchTerm::Add(long long seq)	// Add posting.
+{
+   if (length + 10 > allocated) {
+      allocated = allocated ? allocated * 2 : 16;
+      unsigned char *tmp = new unsigned char[allocated];
+      if (length) memcpy(tmp, postings, length);
+      if (postings) delete[] postings;
+      postings = tmp;
+   }
+   length += Encode(postings + length, seq - last);
+   last = seq;
+   count++;
+}
+
+SearchRun::SearchRun()			// constructor
+{
+   map = NULL;
+   size = 0;
+   header = NULL;
+   table = NULL;
+}
+
+SearchRun::~SearchRun()			// destructor
+{
+   if (map) munmap(map, size);
+}
+
+// Map run file.  Doesn't log, since it's also used by the background thread.
+bool SearchRun::Map(const char *path)
+{
+   struct stat st;
+   int fd;
+
+   if ((fd = open(path, O_RDONLY)) == -1) return false;
+   if (fstat(fd, &st) || st.st_size < off_t(sizeof(SearchRunHeader))) {
+      close(fd);
+      return false;
+   }
+   map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED) {
+      map = NULL;
+      return false;
+   }
+   size = st.st_size;
+   header = (SearchRunHeader *) map;
+   table = (SearchRunEntry *) (map + header->table);
+   if (memcmp(header->magic, "PXS3", 4) || header->table > long(size) ||
+       header->strings > long(size)) {
+      munmap(map, size);
+      map = NULL;
+      return false;
+   }
+   return true;
+}
+
+SearchRunEntry *SearchRun::Find(const char *word) // Find word in run.
+{
+   int low = 0, high = header->words - 1, mid, cmp;
+
+   while (low <= high) {
+      mid = (low + high) / 2;
+      cmp = strcmp(word, map + header->strings + table[mid].word);
+      if (!cmp) return table + mid;
+      if (cmp < 0) {
+         high = mid - 1;
+      } else {
+         low = mid + 1;
+      }
+   }
+   return NULL;
+}
+
+// Build path name for run file with given suffix.
+void Search::RunPath(char *buf, long long first, const char *suffix)
+{
+   sprintf(buf, "%s/%012lld%s", JOURNAL_DIR, first, suffix);
+}
+
+bool Search::AddRun(const char *path)	// Map and add run.
+{
+   SearchRun *run = new SearchRun;
+
+   if (!run->Map(path)) {
+      delete run;
+      return false;
+   }
+   SearchRun **tmp = new SearchRun *[nruns + 1];
+   for (int i = 0; i < nruns; i++) tmp[i] = runs[i];
+   if (runs) delete[] runs;
+   runs = tmp;
+   runs[nruns++] = run;
+   if (run->header->last > last) last = run->header->last;
+   return true;
+}
+
+// Write sorted run file.  Words and posting lists come from "words" and
+// "lists" (with lengths and counts), in sorted order.
+static bool WriteRun(const char *path, long long first, long long last,
+                     int n, const char **words, const unsigned char **lists,
+                     const int *lengths, const int *counts)
+{
+   SearchRunHeader header;
+   SearchRunEntry entry;
+   long offset, strings;
+   FILE *fp;
+   int i;
+
+   if (!(fp = fopen(path, "w"))) return false;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, "PXS3", 4);
+   header.words = n;
+   header.first = first;
+   header.last = last;
+   fwrite(&header, sizeof(header), 1, fp);
+   for (i = 0; i < n; i++) fwrite(lists[i], 1, lengths[i], fp);
+   header.table = ftell(fp);
+   offset = sizeof(header);
+   strings = 0;
+   for (i = 0; i < n; i++) {
+      entry.word = strings;
+      entry.postings = offset;
+      entry.length = lengths[i];
+      entry.count = counts[i];
+      fwrite(&entry, sizeof(entry), 1, fp);
+      offset += lengths[i];
+      strings += strlen(words[i]) + 1;
+   }
+   header.strings = ftell(fp);
+   for (i = 0; i < n; i++) fwrite(words[i], 1, strlen(words[i]) + 1, fp);
+   fseek(fp, 0, SEEK_SET);
+   fwrite(&header, sizeof(header), 1, fp);
+   if (ferror(fp)) {
+      fclose(fp);
+      unlink(path);
+      return false;
+   }
+   return !fclose(fp);
+}
+
+void Search::Dump()			// Write in-memory index as a run.
+{
+   char path[BufSize], tmp[BufSize];
+   SearchTerm **terms, *term;
+   const char **words;
+   const unsigned char **lists;
+   int *lengths, *counts;
+   int i, n = 0;
+
+   if (!postings) return;
+   for (i = 0; i < SearchBuckets; i++) {
+      for (term = buckets[i]; term; term = term->next) n++;
+   }
+   terms = new SearchTerm *[n];
+   for (n = i = 0; i < SearchBuckets; i++) {
+      for (term = buckets[i]; term; term = term->next) terms[n++] = term;
+   }
+   qsort(terms, n, sizeof(SearchTerm *), CompareTerms);
+   words = new const char *[n];
+   lists = new const unsigned char *[n];
+   lengths = new int[n];
+   counts = new int[n];
+   for (i = 0; i < n; i++) {
+      words[i] = terms[i]->word;
+      lists[i] = terms[i]->postings;
+      lengths[i] = terms[i]->length;
+      counts[i] = terms[i]->count;
+   }
+   RunPath(path, first, ".run");
+   RunPath(tmp, first, ".run.tmp");
+   if (!WriteRun(tmp, first, last, n, words, lists, lengths, counts) ||
+       rename(tmp, path) || !AddRun(path)) {
+      warn("Search::Dump(): %s", path);
+   }
+   delete[] words;
+   delete[] lists;
+   delete[] lengths;
+   delete[] counts;
+   for (i = 0; i < n; i++) delete terms[i];
+   delete[] terms;
+   for (i = 0; i < SearchBuckets; i++) buckets[i] = NULL;
+   postings = 0;
+}
+
+static void MergeRuns(void *arg)	// Merge runs. (background thread)
+{
+   SearchMerge *m = (SearchMerge *) arg;
+   char path[BufSize], tmp[BufSize];
+   SearchRun *in = new SearchRun[m->n];
+   int *pos = new int[m->n];
+   int n = 0, allocated = 0, i;
+   const char **words = NULL;
+   unsigned char **lists = NULL;
+   int *lengths = NULL, *counts = NULL;
+   bool ok = true;
+
+   for (i = 0; i < m->n; i++) {
+      Search::RunPath(path, m->firsts[i], ".run");
+      if (!in[i].Map(path)) ok = false;
+      pos[i] = 0;
+   }
+
+   // Merge word tables in order.  The runs cover increasing ranges of
+   // sequence numbers, so posting lists are simply concatenated.
+   while (ok) {
+      const char *word = NULL, *w;
+      PostingCursor cursor;
+      long long prev = 0;
+      unsigned char buf[16];
+
+      for (i = 0; i < m->n; i++) {
+         if (pos[i] >= in[i].header->words) continue;
+         w = in[i].map + in[i].header->strings + in[i].table[pos[i]].word;
+         if (!word || strcmp(w, word) < 0) word = w;
+      }
+      if (!word) break;
+      if (n >= allocated) {
+         allocated = allocated ? allocated * 2 : 1024;
+         const char **w2 = new const char *[allocated];
+         unsigned char **l2 = new unsigned char *[allocated];
+         int *len2 = new int[allocated], *c2 = new int[allocated];
+         for (int j = 0; j < n; j++) {
+            w2[j] = words[j];
+            l2[j] = lists[j];
+            len2[j] = lengths[j];
+            c2[j] = counts[j];
+         }
+         delete[] words;
+         delete[] lists;
+         delete[] lengths;
+         delete[] counts;
+         words = w2;
+         lists = l2;
+         lengths = len2;
+         counts = c2;
+      }
+      int length = 0, size = 0;
+      for (i = 0; i < m->n; i++) {
+         if (pos[i] >= in[i].header->words) continue;
+         SearchRunEntry *e = in[i].table + pos[i];
+         if (strcmp(in[i].map + in[i].header->strings + e->word, word)) {
+            continue;
+         }
+         size += e->length + 10;
+      }
+      lists[n] = new unsigned char[size];
+      counts[n] = 0;
+      for (i = 0; i < m->n; i++) {
+         if (pos[i] >= in[i].header->words) continue;
+         SearchRunEntry *e = in[i].table + pos[i];
+         if (strcmp(in[i].map + in[i].header->strings + e->word, word)) {
+            continue;
+         }
+         cursor.Set((unsigned char *) in[i].map + e->postings, e->length);
+
+         // Only the first delta of each list needs to be re-encoded.
+         if (cursor.Next()) {
+            int len = Encode(buf, cursor.seq - prev);
+            memcpy(lists[n] + length, buf, len);
+            length += len;
+            int rest = cursor.end - cursor.p;
+            memcpy(lists[n] + length, cursor.p, rest);
+            length += rest;
+            while (cursor.Next()) ;
+            prev = cursor.seq;
+         }
+         counts[n] += e->count;
+      }
+      lengths[n] = length;
+      words[n] = word;
+      n++;
+      for (i = 0; i < m->n; i++) {
+         if (pos[i] >= in[i].header->words) continue;
+         SearchRunEntry *e = in[i].table + pos[i];
+         if (!strcmp(in[i].map + in[i].header->strings + e->word, word)) {
+            pos[i]++;
+         }
+      }
+   }
+
+   if (ok) {
+      Search::RunPath(path, m->firsts[0], ".run");
+      Search::RunPath(tmp, m->firsts[0], ".run.tmp");
+      ok = WriteRun(tmp, in[0].header->first, in[m->n - 1].header->last, n,
+                    words, (const unsigned char **) lists, lengths, counts) &&
+         !rename(tmp, path);
+   }
+
+   for (i = 0; i < n; i++) delete[] lists[i];
+   delete[] words;
+   delete[] lists;
+   delete[] lengths;
+   delete[] counts;
+   delete[] pos;
+   delete[] in;
+
+   pthread_mutex_lock(&merge_lock);
+   m->ok = ok;
+   m->done = true;
+   pthread_mutex_unlock(&merge_lock);
+}
+
+void Search::Merge()			// Merge runs in background.
+{
+   if (merging) return;
+   merging = true;
+   merge = new SearchMerge;
+   merge->n = nruns;
+   merge->firsts = new long long[nruns];
+   for (int i = 0; i < nruns; i++) merge->firsts[i] = runs[i]->header->first;
+   merge->done = merge->ok = false;
+   Journal::Background(MergeRuns, merge);
+}
+
+void Search::Poll()			// Check for finished merge.
+{
+   char path[BufSize];
+   SearchRun *run;
+   bool done;
+   int i, n;
+
+   if (!merging) return;
+   pthread_mutex_lock(&merge_lock);
+   done = merge->done;
+   pthread_mutex_unlock(&merge_lock);
+   if (!done) return;
+
+   n = merge->n;
+   if (merge->ok) {
+      RunPath(path, merge->firsts[0], ".run");
+      run = new SearchRun;
+      if (run->Map(path)) {
+         for (i = 0; i < n; i++) {
+            delete runs[i];
+            if (i) {
+               RunPath(path, merge->firsts[i], ".run");
+               unlink(path);
+            }
+         }
+         runs[0] = run;
+         for (i = n; i < nruns; i++) runs[i - n + 1] = runs[i];
+         nruns -= n - 1;
+         log_message("Merged %d search index runs.", n);
+      } else {
+         warn("Search::Poll(): %s", path);
+         delete run;
+      }
+   } else {
+      log_message("Search index merge failed.");
+   }
+   delete[] merge->firsts;
+   delete merge;
+   merge = NULL;
+   merging = false;
+}
+
+void Search::Open()			// Load runs, catch up with journal.
+{
+   long long *found = NULL, seq;
+   int nfound = 0, maxfound = 0, n;
+   char path[BufSize];
+   struct dirent *entry;
+   DIR *dir;
+
+   buckets = new SearchTerm *[SearchBuckets];
+   for (int i = 0; i < SearchBuckets; i++) buckets[i] = NULL;
+
+   if ((dir = opendir(JOURNAL_DIR))) {
+      while ((entry = readdir(dir))) {
+         n = -1;
+         if (sscanf(entry->d_name, "%lld.run%n", &seq, &n) != 1 || n < 0) {
+            continue;
+         }
+         if (!strcmp(entry->d_name + n, ".tmp")) {
+            // Left over from an interrupted dump or merge.
+            RunPath(path, seq, ".run.tmp");
+            unlink(path);
+            continue;
+         }
+         if (entry->d_name[n]) continue;
+         if (nfound >= maxfound) {
+            maxfound = maxfound ? maxfound * 2 : 16;
+            long long *tmp = new long long[maxfound];
+            if (nfound) memcpy(tmp, found, nfound * sizeof(long long));
+            if (found) delete[] found;
+            found = tmp;
+         }
+         found[nfound++] = seq;
+      }
+      closedir(dir);
+   }
+
+   // Runs left over from an interrupted merge are covered by the merged run.
+   for (int i = 0; i < nfound; i++) {
+      for (int j = i + 1; j < nfound; j++) {
+         if (found[j] < found[i]) {
+            seq = found[i];
+            found[i] = found[j];
+            found[j] = seq;
+         }
+      }
+      // Runs in an older format are removed, and rebuilt from the journal.
+      RunPath(path, found[i], ".run");
+      if (found[i] <= last || !AddRun(path)) unlink(path);
+   }
+   if (found) delete[] found;
+
+   // Index anything journaled since the last run was written.
+   JournalReader reader;
+   if (reader.Seek(last + 1)) {
+      while (reader.Next()) Add(reader.seq, reader.rec);
+   }
+   log_message("Search index opened, %d runs, %d postings in memory.", nruns,
+               postings);
+}
+
+// Write out in-memory index, and finish any merge, since the journal's
+// background thread drops queued jobs when it stops.
+void Search::Close()
+{
+   if (buckets) Dump();
+   while (merging) {
+      usleep(10000);
+      Poll();
+   }
+}
+
+// Add posting for word, once per message.
+void Search::AddTerm(long long seq, const char *word)
+{
+   unsigned int hash = Hash(word);
+   SearchTerm *term;
+
+   for (term = buckets[hash]; term; term = term->next) {
+      if (!strcmp(term->word, word)) break;
+   }
+   if (!term) {
+      term = new SearchTerm(word);
+      term->next = buckets[hash];
+      buckets[hash] = term;
+   }
+   if (term->last == seq) return;	// Only once per message.
+   term->Add(seq);
+   postings++;
+}
+
+void Search::Add(long long seq, OutputRecord &rec) // Index record.
+{
+   char word[SearchWordLen], term[TermLen + 2];
+   const char *p = rec.text, *q;
+
+   if (rec.type != PublicMessage && rec.type != PrivateMessage &&
+       rec.type != ChannelMessage) return;
+   if (!buckets || seq <= last) return;
+   if (!postings) first = seq;
+   last = seq;
+   while ((p = NextWord(p, word))) AddTerm(seq, word);
+
+   // Index who may see private and channel messages.
+   if (rec.type != PublicMessage) {
+      AddTerm(seq, Restricted);
+      if (rec.from_id) {
+         AddTerm(seq, VisibilityTerm(term, SenderTerm, rec.from_id,
+                                     TermLen));
+      }
+      if (rec.type == ChannelMessage) {
+         if (rec.to) {
+            AddTerm(seq, VisibilityTerm(term, ChannelTerm, rec.to, TermLen));
+         }
+      } else {
+         // Recipients' identities, separated by newlines.
+         for (p = rec.to_ids; p && *p; p = *q ? q + 1 : q) {
+            if (!(q = strchr(p, '\n'))) q = p + strlen(p);
+            AddTerm(seq, VisibilityTerm(term, RecipientTerm, p, q - p));
+         }
+      }
+   }
+
+   if (postings >= SearchRunPostings) {
+      Dump();
+      if (nruns > SearchMergeRuns) Merge();
+   }
+}
+
+// Set cursor to posting list for word in source (a run, or the in-memory
+// index if source is nruns), or to an empty list if the word isn't there.
+bool Search::Lookup(int source, const char *word, PostingCursor &cursor)
+{
+   SearchTerm *term;
+   SearchRunEntry *e;
+
+   cursor.Set(NULL, 0);
+   if (source == nruns) {
+      if (!buckets) return false;
+      for (term = buckets[Hash(word)]; term; term = term->next) {
+         if (!strcmp(term->word, word)) break;
+      }
+      if (!term) return false;
+      cursor.Set(term->postings, term->length);
+   } else {
+      if (!(e = runs[source]->Find(word))) return false;
+      cursor.Set((unsigned char *) runs[source]->map + e->postings,
+                 e->length);
+   }
+   return true;
+}
+
+// Find up to max messages matching all words of query and visible to the
+// session, newest first.  Returns number of matches found.
+int Search::Find(const char *query, long long *results, int max,
+                 Session *session)
+{
+   char words[SearchQueryWords][SearchWordLen], term[TermLen + 2];
+   PostingCursor cursors[SearchQueryWords], restricted, sender, recipient;
+   PostingCursor *channels;
+   long long *recent, target;
+   int nwords = 0, nchannels = 0, found = 0, want, n, i, j;
+   const char *p = query;
+   Channel *channel;
+   bool all, visible;
+
+   while (nwords < SearchQueryWords && (p = NextWord(p, words[nwords]))) {
+      nwords++;
+   }
+   if (!nwords) return 0;
+
+   for (channel = Channel::First(); channel; channel = channel->next) {
+      if (channel->members.In(session->slot)) nchannels++;
+   }
+   channels = new PostingCursor[nchannels ? nchannels : 1];
+   recent = new long long[max];
+
+   // Search the in-memory index, then runs from newest to oldest.
+   for (int source = nruns; source >= 0 && found < max; source--) {
+      for (i = 0; i < nwords; i++) {
+         if (!Lookup(source, words[i], cursors[i])) break;
+      }
+      if (i < nwords) continue;		// Some word isn't in this source.
+
+      // Posting lists deciding visibility for this session.
+      Lookup(source, Restricted, restricted);
+      Lookup(source, VisibilityTerm(term, SenderTerm, session->identity,
+                                    TermLen), sender);
+      Lookup(source, VisibilityTerm(term, RecipientTerm, session->identity,
+                                    TermLen), recipient);
+      i = 0;
+      for (channel = Channel::First(); channel; channel = channel->next) {
+         if (!channel->members.In(session->slot)) continue;
+         Lookup(source, VisibilityTerm(term, ChannelTerm, channel->name,
+                                       TermLen), channels[i++]);
+      }
+
+      // Intersect posting lists, keeping only the newest visible matches.
+      want = max - found;
+      n = 0;
+      target = 0;
+      for (i = 0; i < nwords; i++) {
+         if (!cursors[i].Next()) break;
+         if (cursors[i].seq > target) target = cursors[i].seq;
+      }
+      while (i == nwords) {
+         all = true;
+         for (i = 0; i < nwords; i++) {
+            while (cursors[i].seq < target && cursors[i].Next()) ;
+            if (cursors[i].seq < target) break;
+            if (cursors[i].seq > target) {
+               target = cursors[i].seq;
+               all = false;
+            }
+         }
+         if (i < nwords) break;
+         if (!all) continue;
+         visible = !restricted.Seek(target) || sender.Seek(target) ||
+            recipient.Seek(target);
+         for (j = 0; !visible && j < nchannels; j++) {
+            visible = channels[j].Seek(target);
+         }
+         if (visible) recent[n++ % want] = target;
+         if (!cursors[0].Next()) break;
+         target = cursors[0].seq;
+      }
+
+      // Newest first.
+      for (j = 1; j <= n && j <= want; j++) {
+         results[found++] = recent[(n - j) % want];
+      }
+   }
+   delete[] channels;
+   delete[] recent;
+   return found;
+}
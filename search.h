@@ -0,0 +1,105 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// search.h -- Search class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _SEARCH_H
+#define _SEARCH_H 1
+
+// Include files.
+#include "output.h"
+#include "phoenix.h"
+
+class PostingCursor;
+
+// Posting list for one word in the in-memory index.  Sequence numbers are
+// stored as variable-length deltas from the previous one.
+class SearchTerm {
+public:
+   char *word;				// case-folded word
+   unsigned char *postings;		// delta-encoded sequence numbers
+   int length;				// bytes used in postings
+   int allocated;			// bytes allocated for postings
+   int count;				// number of postings
+   long long last;			// last sequence number added
+   SearchTerm *next;			// next term in hash chain
+
+   SearchTerm(const char *w);		// constructor
+   ~SearchTerm();			// destructor
+   void Add(long long seq);		// Add posting.
+};
+
+// Header of an index run file.  Runs are written in sequence number order,
+// so each run covers its own range of sequence numbers.  The posting lists
+// follow the header, then the word table (sorted by word), then the words.
+struct SearchRunHeader {
+   char magic[4];			// "PXS3"
+   int words;				// number of words
+   long long first;			// first sequence number covered
+   long long last;			// last sequence number covered
+   long table;				// offset of word table
+   long strings;			// offset of words
+};
+
+// Word table entry of an index run file.
+struct SearchRunEntry {
+   long word;				// offset of word
+   long postings;			// offset of posting list
+   int length;				// length of posting list
+   int count;				// number of postings
+};
+
+// Index run file, mapped read-only.
+class SearchRun {
+public:
+   char *map;				// mapping of run file
+   size_t size;				// size of mapping
+   SearchRunHeader *header;		// run header
+   SearchRunEntry *table;		// word table
+
+   SearchRun();				// constructor
+   ~SearchRun();			// destructor
+   bool Map(const char *path);		// Map run file.
+   SearchRunEntry *Find(const char *word); // Find word in run.
+};
+
+// Full-text search index over the message history journal.
+//
+// New messages are indexed in memory as they are journaled.  Once enough
+// postings accumulate, the in-memory index is written out as a sorted run
+// file; runs are merged by the journal's background thread once there are
+// too many of them.  Queries intersect posting lists for each word, newest
+// run first.  Who may see each private or channel message is indexed too,
+// under terms no query can produce, so visibility is checked against posting
+// lists without reading the journal; only the results shown are fetched.
+class Search {
+private:
+   static SearchTerm **buckets;		// in-memory index hash table
+   static int postings;			// postings in in-memory index
+   static long long first;		// first sequence number in memory
+   static long long last;		// last sequence number indexed
+   static SearchRun **runs;		// mapped runs, oldest first
+   static int nruns;			// number of runs
+   static bool merging;			// merge in progress?
+
+   static bool AddRun(const char *path); // Map and add run.
+   static void AddTerm(long long seq, const char *word); // Add posting.
+   static bool Lookup(int source, const char *word, PostingCursor &cursor);
+   static void Dump();			// Write in-memory index as a run.
+   static void Merge();			// Merge runs in background.
+public:
+   static void Open();			// Load runs, catch up with journal.
+   static void Close();			// Write out in-memory index.
+   static void Add(long long seq, OutputRecord &rec); // Index record.
+   static void Poll();			// Check for finished merge.
+   static int Find(const char *query, long long *results, int max,
+                   Session *session);	// Find visible matches.
+   static void RunPath(char *buf, long long first, const char *suffix);
+};
+
+#endif // search.h
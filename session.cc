@@ -8,15 +8,31 @@
 //
 
 // Include files.
+#include "binary.h"
+#include "channel.h"
+#include "handoff.h"
 #include "line.h"
 #include "phoenix.h"
+#include "resume.h"
+#include "search.h"
 #include "session.h"
 #include "telnet.h"
+#include "timer.h"
 #include "user.h"
 
 Pointer<Session> Session::sessions = NULL;
-
-Session::Session(Telnet *t)
+Bitset Session::slots;
+Session **Session::slot_table = NULL;
+int Session::slot_table_size = 0;
+
+// Input functions, numbered for handoff.
+static InputFuncPtr InputFuncs[] = {
+   NULL, &Session::Login, &Session::Password, &Session::DoName,
+   &Session::Blurb, &Session::ProcessInput
+};
+static const int NumInputFuncs = sizeof(InputFuncs) / sizeof(InputFuncPtr);
+
+Session::Session(Telnet *t): release(this, &Session::ProcessLines)
 {
    time_t now;				// current time
 
@@ -28,16 +44,25 @@ Session::Session(Telnet *t)
    name_only[0] = 0;			// No name.
    name[0] = 0;				// No name/blurb.
    blurb[0] = 0;			// No blurb.
+   identity[0] = 0;			// No identity until signed on.
    strcpy(default_sendlist, "everyone"); // Default sendlist is "everyone".
    last_sendlist[0] = 0;		// No previous sendlist yet.
    reply_sendlist[0] = 0;		// No reply sendlist yet.
 
    InputFunc = NULL;			// No input function.
    lines = NULL;			// No pending input lines.
+   queued = 0;
+   tokens = FloodBurst;			// Full input flood control bucket.
+   token_stamp = Timer::Now();
+   bot_tokens = BotFloodBurst;		// Full bucket for binary input too.
+   bot_token_stamp = token_stamp;
+   flooding = false;			// Not discarding input.
    name_obj = NULL;			// No name object.
    SignalPublic = true;			// Default public signal on. (for now)
    SignalPrivate = true;		// Default private signal on.
    SignedOn = false;			// No signed on yet.
+   resume = 0;				// No resume token yet.
+   slot = -1;				// No session slot yet.
 }
 
 Session::~Session()
@@ -62,69 +87,353 @@ void Session::Close(bool drain)		// Close session.
    if (SignedOn) NotifyExit();		// Notify and log exit if signed on.
 
    SignedOn = false;
+   Resume::Revoke(this);		// Token no longer resumes anything.
+   FreeSlot();				// Leave any channels.
+   lines = NULL;			// Drop input still held back.
+   queued = 0;
+   release.Cancel();
 
-   if (telnet) {
+   while (telnet) {			// Close connections.
       Pointer<Telnet> t(telnet);
-      telnet = NULL;
-      t->Close(drain);			// Close connection.
+      telnet = t->also;
+      t->also = NULL;
+      t->Close(drain);
    }
 
    user = NULL;
 }
 
-void Session::Attach(Telnet *t)		// Attach session to telnet connection.
+// Attach session to another telnet connection.  Only the first connection
+// is announced; later ones just join in, reviewing unacknowledged output.
+void Session::Attach(Telnet *t)
 {
+   Telnet *p;
+   int n = 1;
+
    if (t) {
+      for (p = telnet; p; p = p->also) n++;
+      t->also = telnet;
       telnet = t;
       telnet->session = this;
-      log_message("Attach: %s (%s) on fd #%d.", name_only, user->user,
-                  telnet->fd);
-      EnqueueOthers(new AttachNotify(name_obj));
+      log_message("Attach: %s (%s) on fd #%d. (%d connection%s)", name_only,
+                  user->user, telnet->fd, n, n == 1 ? "" : "s");
+      if (n == 1) Notify(new AttachNotify(name_obj));
       Pending.Attach(telnet);
-      output("*** End of reviewed output. ***\n");
+      if (n == 1) {
+         output("*** End of reviewed output. ***\n");
+      } else {
+         print("*** Session now attached to %d connections. ***\n", n);
+      }
       EnqueueOutput();
    }
 }
 
-void Session::Detach(bool intentional)	// Detach session from connection.
+// Detach session from connection t.  The session is only detached once the
+// last of its connections is gone.
+void Session::Detach(Telnet *t, bool intentional)
 {
-   if (SignedOn && telnet) {
+   Pointer<Telnet> keep(t), p;
+
+   // Unlink connection, unless already done by Close().
+   if (telnet == t) {
+      telnet = t->also;
+   } else {
+      for (p = telnet; p && p->also != t; p = p->also) ;
+      if (!p) return;
+      p->also = t->also;
+   }
+   t->also = NULL;
+
+   if (SignedOn && telnet) {		// Still attached elsewhere.
+      log_message("Detach: %s (%s) on fd #%d. (%s, still attached)",
+                  name_only, user->user, t->fd,
+                  intentional ? "intentional" : "accidental");
+      Pending.Dequeue(telnet);		// Connection no longer holds output.
+   } else if (SignedOn) {
       if (intentional) {
          log_message("Detach: %s (%s) on fd #%d. (intentional)", name_only,
-                     user->user, telnet->fd);
+                     user->user, t->fd);
       } else {
          log_message("Detach: %s (%s) on fd #%d. (accidental)", name_only,
-                     user->user, telnet->fd);
+                     user->user, t->fd);
       }
-      EnqueueOthers(new DetachNotify(name_obj, intentional));
-      telnet = NULL;
+      Notify(new DetachNotify(name_obj, intentional));
+      lines = NULL;			// Drop input still held back.
+      queued = 0;
+      release.Cancel();
    } else {
       Close();
    }
 }
 
-void Session::SaveInputLine(const char *line)
+void Session::Save(Handoff &h)		// Save session state for handoff.
+{
+   Telnet *t;
+   Line *line;
+   int i, n = 0;
+
+   h.PutInt(user->priv);
+   h.PutString(user->user);
+   h.PutString(user->password);
+   h.PutString(user->reserved_name);
+   h.PutString(user->default_blurb);
+   for (i = 0; i < NumInputFuncs && InputFuncs[i] != InputFunc; i++) ;
+   h.PutInt(i < NumInputFuncs ? i : 0);
+   for (line = lines; line; line = line->next) n++;
+   h.PutInt(n);
+   for (line = lines; line; line = line->next) h.PutString(line->line);
+   h.PutLong(login_time);
+   h.PutLong(idle_since);
+   h.PutInt(SignalPublic);
+   h.PutInt(SignalPrivate);
+   h.PutInt(SignedOn);
+   h.PutInt(closing);
+   h.PutString(name_only);
+   h.PutString(name);
+   h.PutString(blurb);
+   h.PutString(name_obj ? name_obj->name : (char *) NULL);
+   h.PutString(identity);
+   h.PutString(default_sendlist);
+   h.PutString(last_sendlist);
+   h.PutString(reply_sendlist);
+   h.PutLong(resume);
+   h.PutInt(slot);
+   Pending.Save(h);
+   for (n = 0, t = telnet; t; t = t->also) n++;
+   h.PutInt(n);
+   for (t = telnet; t; t = t->also) {
+      h.PutInt(t->type);
+      t->Save(h);
+      Pending.SaveCursor(h, t);
+   }
+}
+
+// Restore session state from handoff.
+void Session::Restore(Handoff &h, Pointer<Session> *list, int n)
+{
+   Pointer<Telnet> t, last;
+   unsigned long long hash;
+   char *str;
+   int i;
+
+   user->priv = h.GetInt();
+   h.GetString(user->user, sizeof(user->user));
+   h.GetString(user->password, sizeof(user->password));
+   h.GetString(user->reserved_name, NameLen);
+   h.GetString(user->default_blurb, NameLen);
+   i = h.GetInt();
+   InputFunc = i > 0 && i < NumInputFuncs ? InputFuncs[i] : NULL;
+   for (i = h.GetInt(); i > 0 && h.Ok(); i--) {
+      if ((str = h.GetString())) {
+         SaveInputLine(str);
+         delete[] str;
+      }
+   }
+   login_time = h.GetLong();
+   idle_since = h.GetLong();
+   SignalPublic = h.GetInt();
+   SignalPrivate = h.GetInt();
+   SignedOn = h.GetInt();
+   closing = h.GetInt();
+   h.GetString(name_only, NameLen);
+   h.GetString(name, NameLen);
+   h.GetString(blurb, NameLen);
+   if ((str = h.GetString())) {
+      name_obj = new Name(this, NULL, str);
+      delete[] str;
+   }
+   h.GetString(identity, IdentityLen);
+   h.GetString(default_sendlist, SendlistLen);
+   h.GetString(last_sendlist, SendlistLen);
+   h.GetString(reply_sendlist, SendlistLen);
+   if ((hash = h.GetLong())) Resume::Add(this, hash);
+   if ((i = h.GetInt()) >= 0) TakeSlot(i);
+   Pending.Restore(h);
+   for (i = h.GetInt(); i > 0 && h.Ok(); i--) {
+      if (h.GetInt() == BinaryFD) {
+         t = new Binary;
+      } else {
+         t = new Telnet;
+      }
+      t->Restore(h, this, list, n);
+      Pending.RestoreCursor(h, t);
+      if (t->fd == -1) continue;	// Connection lost.
+      if (last) {
+         last->also = t;
+      } else {
+         telnet = t;
+      }
+      last = t;
+   }
+   if (!telnet && Pending.count > PendingLimit) Pending.SpillOutput(telnet);
+   if (telnet) ProcessLines();		// Resume releasing held input.
+}
+
+// Save all sessions for handoff, then those still logging in.
+void Session::SaveAll(Handoff &h)
+{
+   List<Session> logins;
+   Pointer<Session> session;
+   int n = 0;
+
+   FD::Logins(logins);
+   for (session = sessions; session; session = session->next) n++;
+   h.PutInt(n + logins.Count());
+   for (session = sessions; session; session = session->next) {
+      session->Save(h);
+   }
+   while ((session = logins.Dequeue())) session->Save(h);
+}
+
+void Session::RestoreAll(Handoff &h)	// Restore all sessions.
+{
+   Pointer<Session> *list;
+   int i, n = h.GetInt();
+
+   if (n <= 0 || !h.Ok()) return;
+
+   // Create all sessions first, so connections can refer to any of them.
+   list = new Pointer<Session>[n];
+   for (i = 0; i < n; i++) list[i] = new Session(NULL);
+   for (i = 0; i < n && h.Ok(); i++) list[i]->Restore(h, list, n);
+   for (i = n - 1; i >= 0; i--) {
+      if (!list[i]->SignedOn) continue;	// Still logging in.
+      list[i]->next = sessions;
+      sessions = list[i];
+   }
+   delete[] list;
+}
+
+int Session::Index(Session *session)	// Position of session in list.
+{
+   Session *s;
+   int i = 0;
+
+   if (!session) return -1;
+   for (s = sessions; s; s = s->next, i++) {
+      if (s == session) return i;
+   }
+   return -1;
+}
+
+// Find signed-on session with identity, preferring one still using name.
+Session *Session::Identified(const char *id, const char *name)
+{
+   Session *s, *found = NULL;
+
+   if (!id || !*id) return NULL;
+   for (s = sessions; s; s = s->next) {
+      if (!s->SignedOn || strcasecmp(s->identity, id)) continue;
+      if (!strcmp(s->name, name)) return s;
+      if (!found) found = s;
+   }
+   return found;
+}
+
+// Take a session slot, the lowest free one unless i is given.  Slots are
+// small dense numbers, so channel member sets can be bitsets.
+void Session::TakeSlot(int i)
+{
+   Session **tmp;
+   int n;
+
+   if (i < 0) i = slots.FirstFree();
+   if (i >= slot_table_size) {
+      for (n = slot_table_size ? slot_table_size : 64; n <= i; n *= 2) ;
+      tmp = new Session *[n];
+      if (slot_table_size) {
+         memcpy(tmp, slot_table, slot_table_size * sizeof(Session *));
+      }
+      memset(tmp + slot_table_size, 0,
+             (n - slot_table_size) * sizeof(Session *));
+      if (slot_table) delete[] slot_table;
+      slot_table = tmp;
+      slot_table_size = n;
+   }
+   slots.Add(i);
+   slot_table[i] = this;
+   slot = i;
+}
+
+void Session::FreeSlot()		// Free session slot, leave channels.
+{
+   if (slot < 0) return;
+   Channel::LeaveAll(slot);
+   slots.Remove(slot);
+   slot_table[slot] = NULL;
+   slot = -1;
+}
+
+void Session::SaveInputLine(const char *line, bool binary)
 {
    Line *p;
 
-   p = new Line(line);
+   p = new Line(line, binary);
    if (lines) {
       lines->Append(p);
    } else {
       lines = p;
    }
+   queued++;
 }
 
 void Session::SetInputFunction(InputFuncPtr input)
 {
    InputFunc = input;
+   ProcessLines();			// Process any lines waiting.
+}
+
+// Take an input flood control token, if available.  Tokens only apply once
+// signed on, and refill at one per FloodInterval, up to FloodBurst.  Input
+// from binary connections (bots) draws on a separate, larger bucket.
+bool Session::TakeToken(bool binary)
+{
+   int &count = binary ? bot_tokens : tokens;
+   long long &stamp = binary ? bot_token_stamp : token_stamp;
+   int burst = binary ? BotFloodBurst : FloodBurst;
+   int interval = binary ? BotFloodInterval : FloodInterval;
+   long long now = Timer::Now();
+   int gained = (now - stamp) * TimerTick / interval;
+
+   if (!SignedOn) return true;
+   if (count + gained >= burst) {
+      count = burst;
+      stamp = now;
+   } else if (gained > 0) {
+      count += gained;
+      stamp += gained * interval / TimerTick;
+   }
+   if (!count) return false;
+   count--;
+   return true;
+}
+
+// Process waiting input lines, as long as there's an input function and
+// flood control allows.  If lines are still held back, try again as soon
+// as the next token is due.
+void Session::ProcessLines()
+{
+   Pointer<Line> line;
 
-   // Process lines as long as we still have a defined input function.
-   while (InputFunc != NULL && lines) {
-      (this->*InputFunc)(lines->line);
+   while (InputFunc != NULL && lines && TakeToken(lines->binary)) {
+      line = lines;
       lines = lines->next;
+      queued--;
+      (this->*InputFunc)(line->line);
       EnqueueOutput();			// Enqueue output buffer (if any).
    }
+   if (!lines) {
+      flooding = false;
+      release.Cancel();
+   } else if (InputFunc != NULL && !release.IsSet()) {
+      if (lines->binary) {
+         release.SetMsec(BotFloodInterval -
+                         (Timer::Now() - bot_token_stamp) * TimerTick);
+      } else {
+         release.SetMsec(FloodInterval -
+                         (Timer::Now() - token_stamp) * TimerTick);
+      }
+   }
 }
 
 void Session::InitInputFunction()	// Initialize input function to Login.
@@ -132,14 +441,42 @@ void Session::InitInputFunction()	// Initialize input function to Login.
    SetInputFunction(&Session::Login);
 }
 
-void Session::Input(const char *line)	// Process an input line.
+void Session::AcknowledgeOutput(Telnet *t) // Output acknowledgement.
+{
+   Pending.Acknowledge(t);
+   if (t->slow && Pending.Backlog(t) <= PendingLimit / 2) {
+      t->slow = false;			// Slow reader caught up.
+   }
+}
+
+// Process an input line from connection t.
+void Session::Input(Telnet *t, const char *line)
 {
-   Pending.Dequeue();			// Dequeue all acknowledged output.
-   if (InputFunc) {			// If available, call immediately.
+   Pointer<Telnet> keep(t), p;
+
+   // Responses go to the connection most recently used.
+   if (telnet != t) {
+      for (p = telnet; p && p->also != t; p = p->also) ;
+      if (p) {
+         p->also = t->also;
+         t->also = telnet;
+         telnet = t;
+      }
+   }
+   Pending.Dequeue(telnet);		// Dequeue all acknowledged output.
+   // If allowed, call immediately.
+   if (InputFunc && !lines && TakeToken(t->type == BinaryFD)) {
       (this->*InputFunc)(line);
       EnqueueOutput();			// Enqueue output buffer (if any).
-   } else {				// Otherwise, save input line for later.
-      SaveInputLine(line);
+   } else if (queued < FloodQueueMax) { // Otherwise, save line for later.
+      SaveInputLine(line, t->type == BinaryFD);
+      ProcessLines();			// Schedule release.
+   } else if (!flooding) {		// Too many held back, discard.
+      flooding = true;
+      log_message("Input flood: %s (%s) on fd #%d, discarding input.",
+                  name_only, user->user, telnet ? telnet->fd : -1);
+      output("*** Too much input, discarding lines until caught up. ***\n");
+      EnqueueOutput();
    }
 }
 
@@ -205,6 +542,12 @@ void Session::Login(const char *line)	// Process response to login prompt.
 //      DoIdle();
 //      telnet->Prompt("login: ");
 //      return;
+   } else if (!strncasecmp(line, "resume ", 7)) {
+      if (!DoResume(line + 7)) {
+         telnet->output("Invalid resume token.\n");
+         telnet->Prompt("login: ");
+      }
+      return;
    } else if (!strcasecmp(line, "guest")) {
       strcpy(user->user, line);
       name[0] = 0;
@@ -244,22 +587,25 @@ void Session::Login(const char *line)	// Process response to login prompt.
       }
    }
 
-   // Warn if echo can't be turned off.
-   if (!telnet->Echo) {
-      telnet->output("\n\aSorry, password WILL echo.\n\n");
-   } else if (telnet->Echo != TelnetEnabled) {
-      telnet->output("\nWarning: password may echo.\n\n");
+   // Warn if echo can't be turned off.  (A client editing lines locally is
+   // asked to stop echoing instead.)
+   if (!telnet->edit) {
+      if (!telnet->Echo) {
+         telnet->output("\n\aSorry, password WILL echo.\n\n");
+      } else if (telnet->Echo != TelnetEnabled) {
+         telnet->output("\nWarning: password may echo.\n\n");
+      }
    }
 
    telnet->Prompt("Password: ");	// Prompt for password.
-   telnet->DoEcho = false;		// Disable echoing.
+   telnet->EchoInput(false);		// Disable echoing.
    SetInputFunction(&Session::Password); // Set password input routine.
 }
 
 void Session::Password(const char *line) // Process response to password prompt.
 {
    telnet->output(Newline);		// Send newline.
-   telnet->DoEcho = true;		// Enable echoing.
+   telnet->EchoInput(true);		// Enable echoing.
 
    // Check against encrypted password.
    if (strcmp(crypt(line, user->password), user->password)) {
@@ -289,8 +635,14 @@ void Session::DoName(const char *line)	// Process response to name prompt.
    Session *session;
    for (session = sessions; session; session = session->next) {
       if (!strcasecmp(session->name_only, name_only)) {
-         if (!strcmp(session->user->user, user->user) && !session->telnet) {
-            telnet->output("Re-attaching to detached session...\n");
+         // Guests may only take over detached sessions.
+         if (!strcmp(session->user->user, user->user) &&
+             (!session->telnet || strcasecmp(user->user, "guest"))) {
+            if (session->telnet) {
+               telnet->output("Attaching to active session...\n");
+            } else {
+               telnet->output("Re-attaching to detached session...\n");
+            }
             session->Attach(telnet);
             telnet = NULL;
             Close();
@@ -306,6 +658,19 @@ void Session::DoName(const char *line)	// Process response to name prompt.
    SetInputFunction(&Session::Blurb);	// Set blurb input routine.
 }
 
+// Resume session by token, from the login prompt or telnet negotiation.
+bool Session::DoResume(const char *token)
+{
+   Session *session = Resume::Find(token);
+
+   if (!session || session == this || !session->SignedOn) return false;
+   telnet->output("Resuming session...\n");
+   session->Attach(telnet);
+   telnet = NULL;
+   Close();
+   return true;
+}
+
 void Session::Blurb(const char *line)	// Process response to blurb prompt.
 {
    if (!line || !*line) line = user->default_blurb;
@@ -319,11 +684,14 @@ void Session::Blurb(const char *line)	// Process response to blurb prompt.
 
    SignedOn = true;			// Session is signed on.
 
+   SetIdentity();			// Choose identity for message history.
    NotifyEntry();			// Notify other users of entry.
 
    // Print welcome banner and do a /who list.
    output("\n\nWelcome to Phoenix.  Type \"/help\" for a list of commands."
           "\n\n");
+   print("To get back in if your connection drops, enter \"resume %s\" at "
+         "the login prompt.\n", Resume::Issue(this));
    DoWho();				// Enqueues output.
 
    SetInputFunction(&Session::ProcessInput); // Set normal input routine.
@@ -351,6 +719,8 @@ void Session::ProcessInput(const char *line) // Process normal input.
          while (*line && !isspace(*line)) line++;
          while (*line && isspace(*line)) line++;
          DoNuke(line);
+      } else if (!strcasecmp(line, "!upgrade")) {
+         DoUpgrade();
       } else {
          // Unknown !command.
          output("Unknown !command.\n");
@@ -372,8 +742,16 @@ void Session::ProcessInput(const char *line) // Process normal input.
          DoDate();
       } else if (!strncasecmp(line, "/signal", 7)) {
          DoSignal(line + 7);
+      } else if (!strncasecmp(line, "/split", 6)) {
+         DoSplit(line + 6);
       } else if (!strncasecmp(line, "/send", 5)) {
          DoSend(line + 5);
+      } else if (!strncasecmp(line, "/join", 5)) {
+         DoJoin(line + 5);
+      } else if (!strncasecmp(line, "/leave", 6)) {
+         DoLeave(line + 6);
+      } else if (!strncasecmp(line, "/channels", 5)) {
+         DoChannels();
       } else if (!strncasecmp(line, "/why", 4)) {
          DoWhy();
       } else if (!strncasecmp(line, "/blurb", 3)) { // /blurb command.
@@ -381,6 +759,12 @@ void Session::ProcessInput(const char *line) // Process normal input.
          DoBlurb(line);
       } else if (!strncasecmp(line, "/help", 5)) { // /help command.
          DoHelp();
+      } else if (!strncasecmp(line, "/review", 7)) {
+         DoReview(line + 7);
+      } else if (!strncasecmp(line, "/last", 5)) {
+         DoLast(line + 5);
+      } else if (!strncasecmp(line, "/search", 7)) {
+         DoSearch(line + 7);
       } else {				// Unknown /command.
          output("Unknown /command.  Type /help for help.\n");
       }
@@ -391,12 +775,32 @@ void Session::ProcessInput(const char *line) // Process normal input.
    }
 }
 
+// Private and channel messages are journaled under the identities of the
+// sender and recipients, since anyone can take a name once it's free.  An
+// account is its own identity; each guest session gets a random one.
+void Session::SetIdentity()
+{
+   unsigned char buf[8];
+   int i;
+
+   if (strcasecmp(user->user, "guest")) {
+      strcpy(identity, user->user);
+      return;
+   }
+   Resume::Random(buf, sizeof(buf));
+   strcpy(identity, "guest:");
+   for (i = 0; i < int(sizeof(buf)); i++) {
+      sprintf(identity + 6 + 2 * i, "%02x", buf[i]);
+   }
+}
+
 void Session::NotifyEntry()		// Notify other users of entry and log.
 {
    log_message("Enter: %s (%s) on fd #%d.", name_only, user->user, telnet->fd);
-   EnqueueOthers(new EntryNotify(name_obj, idle_since = time(&login_time)));
+   Notify(new EntryNotify(name_obj, idle_since = time(&login_time)));
    next = sessions;			// Link session into global list.
    sessions = this;
+   TakeSlot();				// Take slot for channel membership.
    // XXX Link new session into user list.
 }
 
@@ -408,7 +812,7 @@ void Session::NotifyExit()		// Notify other users of exit and log.
    } else {
       log_message("Exit: %s (%s), detached.", name_only, user->user);
    }
-   EnqueueOthers(new ExitNotify(name_obj));
+   Notify(new ExitNotify(name_obj));
 }
 
 int Session::ResetIdle(int min)		// Reset/return idle time, maybe report.
@@ -444,17 +848,17 @@ void Session::DoRestart(const char *args) // Do !restart command.
       log_message("Final shutdown warning.");
       announce("*** %s has restarted conf! ***\n", name);
       announce("\a\a>>> Server restarting NOW!  Goodbye. <<<\n\a\a");
-      alarm(5);
+      ShutdownTimer.Set(5);
       Shutdown = 4;
    } else if (!strcasecmp(args, "cancel")) {
       if (Shutdown > 2) {
          Shutdown = 0;
-         alarm(0);
+         ShutdownTimer.Cancel();
          log_message("Restart cancelled by %s (%s).", name_only, user->user);
          announce("*** %s has cancelled the server restart. ***\n", name);
       } else if (Shutdown) {
          Shutdown = 0;
-         alarm(0);
+         ShutdownTimer.Cancel();
          log_message("Shutdown cancelled by %s (%s).", name_only, user->user);
          announce("*** %s has cancelled the server shutdown. ***\n", name);
       } else {
@@ -468,7 +872,7 @@ void Session::DoRestart(const char *args) // Do !restart command.
       announce("*** %s has restarted conf! ***\n", name);
       announce("\a\a>>> This server will restart in %d seconds... <<<\n\a\a",
                seconds);
-      alarm(seconds);
+      ShutdownTimer.Set(seconds);
       Shutdown = 3;
    }
 }
@@ -481,17 +885,17 @@ void Session::DoDown(const char *args)	// Do !down command.
       log_message("Final shutdown warning.");
       announce("*** %s has shut down Phoenix! ***\n", name);
       announce("\a\a>>> Server shutting down NOW!  Goodbye. <<<\n\a\a");
-      alarm(5);
+      ShutdownTimer.Set(5);
       Shutdown = 2;
    } else if (!strcasecmp(args, "cancel")) {
       if (Shutdown > 2) {
          Shutdown = 0;
-         alarm(0);
+         ShutdownTimer.Cancel();
          log_message("Restart cancelled by %s (%s).", name_only, user->user);
          announce("*** %s has cancelled the server restart. ***\n", name);
       } else if (Shutdown) {
          Shutdown = 0;
-         alarm(0);
+         ShutdownTimer.Cancel();
          log_message("Shutdown cancelled by %s (%s).", name_only, user->user);
          announce("*** %s has cancelled the server shutdown. ***\n", name);
       } else {
@@ -505,11 +909,22 @@ void Session::DoDown(const char *args)	// Do !down command.
       announce("*** %s has shut down Phoenix! ***\n", name);
       announce("\a\a>>> This server will shutdown in %d seconds... <<<\n\a\a",
                seconds);
-      alarm(seconds);
+      ShutdownTimer.Set(seconds);
       Shutdown = 1;
    }
 }
 
+void Session::DoUpgrade()		// Do !upgrade command.
+{
+   if (Shutdown) {
+      output("The server is already about to shut down or restart.\n");
+      return;
+   }
+   log_message("Upgrade requested by %s (%s).", name_only, user->user);
+   output("Upgrading server, connections will be handed off...\n");
+   Upgrade = true;			// Upgrade from main loop.
+}
+
 void Session::DoNuke(const char *args)	// Do !nuke command.
 {
    bool drain;
@@ -527,15 +942,17 @@ void Session::DoNuke(const char *args)	// Do !nuke command.
       }
 
       if (session->telnet) {
-         Pointer<Telnet> telnet(session->telnet);
-         session->telnet = NULL;
-         log_message("%s (%s) on fd %d has been nuked by %s (%s).",
-                     session->name_only, session->user->user, telnet->fd,
-                     name_only, user->user);
-         telnet->UndrawInput();
-         telnet->print("\a\a\a*** You have been nuked by %s. ***\n", name);
-         telnet->RedrawInput();
-         telnet->Close(drain);
+         Telnet *telnet;
+         for (telnet = session->telnet; telnet; telnet = telnet->also) {
+            log_message("%s (%s) on fd %d has been nuked by %s (%s).",
+                        session->name_only, session->user->user, telnet->fd,
+                        name_only, user->user);
+            telnet->UndrawInput();
+            telnet->print("\a\a\a*** You have been nuked by %s. ***\n",
+                          name);
+            telnet->RedrawInput();
+         }
+         session->Close(drain);
       } else {
          log_message("%s (%s), detached, has been nuked by %s (%s).",
                      session->name_only, session->user->user, name_only,
@@ -572,13 +989,24 @@ void Session::DoBye()			// Do /bye command.
 
 void Session::DoClear()			// Do /clear command.
 {
-   output("\033[H\033[J");		// XXX ANSI!
+   if (telnet && telnet->split) {
+      output("\033[1J");			// Clear above input line. XXX ANSI!
+   } else {
+      output("\033[H\033[J");		// XXX ANSI!
+   }
 }
 
 void Session::DoDetach()		// Do /detach command.
 {
-   output("You have been detached.\n");
-   EnqueueOutput();
+   if (telnet && telnet->also) {	// Only this connection is detached.
+      if (telnet->dirty) telnet->Render();
+      telnet->UndrawInput();
+      telnet->output("You have been detached.\n");
+      telnet->RedrawInput();
+   } else {
+      output("You have been detached.\n");
+      EnqueueOutput();
+   }
    if (telnet) telnet->Close();		// Drain connection, then close.
 }
 
@@ -641,6 +1069,75 @@ void Session::DoWho()			// Do /who command.
    }
 }
 
+// Parse channel name argument, with or without "#".
+static const char *ChannelArg(const char *args, char *name)
+{
+   int i = 0;
+
+   while (*args && isspace(*args)) args++;
+   if (*args == '#') args++;
+   while (*args && !isspace(*args) && i < NameLen - 1) name[i++] = *args++;
+   name[i] = 0;
+   while (*args && isspace(*args)) args++;
+   return *args || !Channel::ValidName(name) ? NULL : name;
+}
+
+void Session::DoJoin(const char *args)	// Do /join command.
+{
+   Channel *channel;
+   char name[NameLen];
+   int n;
+
+   if (!ChannelArg(args, name)) {
+      output("Usage: /join <channel>  (letters, digits, \"-\" and \"_\")\n");
+      return;
+   }
+   if ((channel = Channel::Find(name)) && channel->members.In(slot)) {
+      print("You are already in #%s.\n", channel->name);
+      return;
+   }
+   channel = Channel::Join(name, slot);
+   n = channel->members.Count();
+   print("You have joined #%s. [%d member%s]\n", channel->name, n,
+         n == 1 ? "" : "s");
+}
+
+void Session::DoLeave(const char *args)	// Do /leave command.
+{
+   Channel *channel;
+   char name[NameLen];
+
+   if (!ChannelArg(args, name)) {
+      output("Usage: /leave <channel>\n");
+   } else if (!(channel = Channel::Find(name)) ||
+              !channel->members.In(slot)) {
+      print("You are not in #%s.\n", name);
+   } else {
+      print("You have left #%s.\n", channel->name);
+      channel->Leave(slot);
+   }
+}
+
+void Session::DoChannels()		// Do /channels command.
+{
+   Channel *channel;
+
+   if (!Channel::First()) {
+      output("There are no channels.  (/join <channel> to start one)\n");
+      return;
+   }
+
+   // Output /channels header.
+   output("\n Channel                           Members\n"
+          " -------                           -------\n");
+
+   // Output each channel, marking the ones joined.
+   for (channel = Channel::First(); channel; channel = channel->next) {
+      print("%c#%-32s %7d\n", channel->members.In(slot) ? '*' : ' ',
+            channel->name, channel->members.Count());
+   }
+}
+
 void Session::DoIdle()			// Do /idle command.
 {
    int idle, days, hours, minutes;
@@ -740,6 +1237,26 @@ void Session::DoSignal(const char *p)	// Do /signal command.
    }
 }
 
+void Session::DoSplit(const char *p)	// Do /split command.
+{
+   if (!telnet) return;
+   while (*p && isspace(*p)) p++;
+   if (!*p) {
+      print("Split-screen input is %s.\n", telnet->split ? "on" : "off");
+   } else if (!strncasecmp(p, "on", 2)) {
+      if (telnet->SplitScreen(true)) {
+         output("Split-screen input is now on.\n");
+      } else {
+         output("Split-screen input needs server echo.\n");
+      }
+   } else if (!strncasecmp(p, "off", 3)) {
+      telnet->SplitScreen(false);
+      output("Split-screen input is now off.\n");
+   } else {
+      output("/split syntax error!\n");
+   }
+}
+
 void Session::DoSend(const char *p)	// Do /send command.
 {
    while (*p && isspace(*p)) p++;
@@ -817,13 +1334,20 @@ int Session::DoBlurb(const char *start, bool entry)
 void Session::DoHelp()			// Do /help command.
 {
    output("Known commands: /blurb (set a descriptive blurb), /bye (leave "
-          "Phoenix), /date\n"
-          "(display current date and time), /detach (disconnect without "
-          "leaving), /help,\n"
-          "/send (specify default sendlist), /signal (turns public/private "
-          "signals on or\n"
-          "off), /who (gives a list of who is signed on), /why (because we "
-          "like you!).\n\n"
+          "Phoenix),\n"
+          "/channels (list channels), /date (display current date and time), "
+          "/detach\n"
+          "(disconnect without leaving), /help, /join (join a channel), /last "
+          "(review\n"
+          "the last 10 or /last <n> messages), /leave (leave a channel), "
+          "/review\n"
+          "(review messages from the last hour or /review <minutes>), /send "
+          "(specify\n"
+          "default sendlist), /signal (turns public/private signals on or "
+          "off), /split\n"
+          "(keeps your input line at the bottom of the screen), /who (gives a "
+          "list of\n"
+          "who is signed on), /why (because we like you!).\n\n"
           "To send a private message to a user, type the user's full name or "
           "any\n"
           "unique substring of the user's name (case-insensitive) followed by "
@@ -831,7 +1355,15 @@ void Session::DoHelp()			// Do /help command.
           "a semicolon or a colon and the message.  If you're in the mood to "
           "talk to\n"
           "yourself, you can use your own name or \"me\" as a keyword.  (e.g. "
-          "\"me;hi\")\n\n"
+          "\"me;hi\")  Separate several names with commas to send one "
+          "message to all\n"
+          "of them.  (e.g. \"alice,bob:hi\")\n\n"
+          "To send a message to a channel you have joined, use \"#\" and the "
+          "channel\n"
+          "name as the sendlist.  (e.g. \"#chat:hi\")  Only the channel's "
+          "members see it.\n"
+          "Channels and names can be mixed in one sendlist.  (e.g. "
+          "\"#chat,carol:hi\")\n\n"
           "Any line beginning with a slash is a user command.  Lines beginning "
           "with an\n"
           "exclamation point are privileged commands.  Any other line that "
@@ -849,6 +1381,121 @@ void Session::DoHelp()			// Do /help command.
           ":( :P ;)\n\n");
 }
 
+void Session::Review(Output *out)	// Enqueue reviewed output object.
+{
+   Pointer<Output> keep(out);
+   Enqueue(out);
+}
+
+void Session::Review(JournalFetch *fetch) // Enqueue records fetched.
+{
+   OutputRecord rec;
+   int pos, n;
+
+   for (pos = 0; pos < fetch->size; pos += n) {
+      if (!(n = rec.Unpack(fetch->records + pos, fetch->size - pos))) break;
+      Review(rec.Load());
+   }
+}
+
+// Do /review command.  The journal is read in the background; Reviewed()
+// shows what was found.
+void Session::DoReview(const char *args)
+{
+   JournalFetch *fetch = new JournalFetch(this, &Session::Reviewed, args, 0);
+   int minutes;
+
+   if (sscanf(args, "%d", &minutes) != 1 || minutes <= 0) minutes = 60;
+   fetch->since = time(NULL) - minutes * 60;
+   fetch->limit = ReviewLimit;
+   Journal::Fetch(fetch);
+}
+
+void Session::Reviewed(JournalFetch *fetch) // Show records fetched.
+{
+   int minutes;
+
+   if (sscanf(fetch->args, "%d", &minutes) != 1 || minutes <= 0) {
+      minutes = 60;
+   }
+   if (!fetch->count) {
+      print("There are no messages from the last %d minute%s.\n", minutes,
+            minutes == 1 ? "" : "s");
+   } else {
+      print("*** Reviewing messages since %s. ***\n",
+            date(fetch->since, 4, 12));
+      Review(fetch);
+      if (fetch->more) {
+         print("*** Review stopped after %d messages. ***\n", ReviewLimit);
+      } else {
+         output("*** End of review. ***\n");
+      }
+   }
+   EnqueueOutput();
+}
+
+void Session::DoLast(const char *args)	// Do /last command.
+{
+   long long seq, *found;
+   OutputRecord rec;
+   int n, count = 0;
+
+   if (sscanf(args, "%d", &n) != 1 || n <= 0) n = 10;
+   if (n > ReviewLimit) n = ReviewLimit;
+
+   // Find visible records backwards through the in-memory journal tail.
+   found = new long long[n];
+   for (seq = Journal::Next() - 1; seq >= Journal::TailFirst() && count < n;
+        seq--) {
+      if (Journal::Recent(seq, rec) && rec.VisibleTo(this)) {
+         found[count++] = seq;
+      }
+   }
+   if (!count) {
+      output("There are no messages to review.\n");
+   } else {
+      while (count--) {
+         if (Journal::Recent(found[count], rec)) Review(rec.Load());
+      }
+      output("*** End of review. ***\n");
+   }
+   delete[] found;
+}
+
+// Do /search command.  The index says which records match; they're read
+// from the journal in the background, and Searched() shows them.
+void Session::DoSearch(const char *args)
+{
+   long long results[SearchLimit];
+   JournalFetch *fetch;
+   int n, i;
+
+   while (*args == ' ') args++;
+   if (!*args) {
+      output("Usage: /search <words>\n");
+      return;
+   }
+   if (!(n = Search::Find(args, results, SearchLimit, this))) {
+      print("There are no messages matching \"%s\".\n", args);
+      return;
+   }
+   fetch = new JournalFetch(this, &Session::Searched, args, n);
+   for (i = 0; i < n; i++) fetch->seqs[i] = results[n - 1 - i]; // Oldest first.
+   fetch->nseqs = n;
+   Journal::Fetch(fetch);
+}
+
+void Session::Searched(JournalFetch *fetch) // Show records fetched.
+{
+   int n = fetch->nseqs;
+
+   print("*** %s%d message%s matching \"%s\": ***\n",
+         n == SearchLimit ? "Last " : "", n, n == 1 ? "" : "s", fetch->args);
+   Review(fetch);
+   output("*** End of search results. ***\n");
+   EnqueueOutput();
+}
+
 void Session::DoReset()			// Do <space><return> idle time reset.
 {
    ResetIdle(1);
@@ -889,6 +1536,8 @@ void Session::DoMessage(const char *line) // Do message send.
 
    if (!strcasecmp(sendlist, "everyone")) {
       SendEveryone(p);
+   } else if (*sendlist == '#' && !strchr(sendlist, ',')) {
+      SendChannel(sendlist + 1, p);
    } else {
       SendPrivate(sendlist, p);
    }
@@ -899,7 +1548,9 @@ void Session::SendEveryone(const char *msg)
 {
    int sent = 0;
    Session *session;
-   last_message = new Message(PublicMessage, name_obj, NULL, msg);
+   last_message = new Message(PublicMessage, name_obj, (Session *) NULL,
+                              msg);
+   Journal::Log(last_message);
    for (session = sessions; session; session = session->next) {
       if (session == this) continue;
       session->Enqueue(last_message);
@@ -921,44 +1572,204 @@ void Session::SendEveryone(const char *msg)
    }
 }
 
-// Send private message by partial name match.
+// Send private message by partial name match.  A comma-separated sendlist
+// names several recipients; all the names are matched in a single pass over
+// the sessions, collecting the recipients' slots so duplicates collapse, and
+// they all share one message.  Entries starting with "#" add the other
+// members of a channel the sender is in, as a union of its member bits.
 void Session::SendPrivate(const char *sendlist, const char *msg)
 {
+   Session *exact[SendlistNames], *lead[SendlistNames], *match[SendlistNames];
+   int leads[SendlistNames], count[SendlistNames];
+   char buf[SendlistLen], shown[SendlistLen], *names[SendlistNames];
+   char *list, *ids, *p, *q;
+   Bitset recipients, members;
+   Channel *channel;
    Session *session;
-   Set<Session> matches;
-
-   if ((session = FindSession(sendlist, matches))) {
-      ResetIdle(10);
-      print("(message sent to %s.)\n", session->name);
-      last_message = new Message(PrivateMessage, name_obj, session, msg);
-      session->Enqueue(last_message);
-   } else {
-      // XXX kludge
-      for (unsigned char *p = (unsigned char *) sendlist; *p; p++) {
-         if (*p == UnquotedUnderscore) *p = Underscore;
+   int i, n = 0, pos, failed = 0;
+
+   // Split sendlist into names.
+   strncpy(buf, sendlist, SendlistLen);
+   buf[SendlistLen - 1] = 0;
+   for (p = strtok(buf, ","); p; p = strtok(NULL, ",")) {
+      if (n == SendlistNames) {
+         print("\a\aToo many names in sendlist. (limit %d, message not "
+               "sent)\n", SendlistNames);
+         return;
       }
+      names[n] = p;
+      exact[n] = !strcasecmp(p, "me") ? this : NULL;
+      lead[n] = match[n] = NULL;
+      leads[n] = count[n] = 0;
+      n++;
+   }
 
-      last_message = new Message(PrivateMessage, name_obj, session, msg);
+   // Names as shown in errors, with unquoted underscores spelled normally;
+   // matching still uses the originals, so an unquoted one matches a space.
+   for (i = 0; i < SendlistLen; i++) {
+      shown[i] = buf[i] == char(UnquotedUnderscore) ? Underscore : buf[i];
+   }
 
-      if (matches.Count()) {
-         SetIter<Session> iter(matches);
+   // Match every name against each session.
+   for (session = sessions; session; session = session->next) {
+      for (i = 0; i < n; i++) {
+         if (exact[i] || *names[i] == '#') continue;
+         if (!strcasecmp(session->name_only, names[i])) {
+            exact[i] = session;
+         } else if ((pos = match_name(session->name_only, names[i]))) {
+            if (pos == 1) {
+               leads[i]++;
+               lead[i] = session;
+            }
+            count[i]++;
+            match[i] = session;
+         }
+      }
+   }
 
-         print("\a\a\"%s\" matches %d names: ", sendlist, matches.Count());
-         output(iter++->name_only);
-         while (iter++) {
-            output(", ");
-            output(iter->name_only);
+   // Collect recipients, reporting any names that didn't resolve.
+   for (i = 0; i < n; i++) {
+      if (*names[i] == '#') {
+         p = shown + (names[i] - buf) + 1;
+         if ((channel = Channel::Find(p)) && channel->members.In(slot)) {
+            members.Union(channel->members);
+         } else {
+            print("\a\aYou are not in #%s. (message not sent)\n", p);
+            failed++;
+         }
+         continue;
+      }
+      if (!(session = exact[i])) {
+         if (leads[i] == 1) {
+            session = lead[i];
+         } else if (count[i] == 1) {
+            session = match[i];
+         }
+      }
+      if (session) {
+         recipients.Add(session->slot);
+         continue;
+      }
+      failed++;
+      if (count[i]) {
+         const char *sep = "";
+
+         print("\a\a\"%s\" matches %d names: ", shown + (names[i] - buf),
+               count[i]);
+         for (session = sessions; session; session = session->next) {
+            if (match_name(session->name_only, names[i])) {
+               output(sep);
+               output(session->name_only);
+               sep = ", ";
+            }
          }
          output(". (message not sent)\n");
       } else {
-         print("\a\aNo names matched \"%s\". (message not sent)\n", sendlist);
+         print("\a\aNo names matched \"%s\". (message not sent)\n",
+               shown + (names[i] - buf));
       }
    }
+   if (!n) {
+      print("\a\aNo names matched \"%s\". (message not sent)\n", sendlist);
+   }
+   if (!failed && n) {
+      members.Remove(slot);		// Channels don't echo to the sender.
+      recipients.Union(members);
+      if (!recipients.Count()) {
+         print("\a\aThere is no one else in %s! (message not sent)\n",
+               sendlist);
+         failed++;
+      }
+   }
+   if (failed || !n) {
+      last_message = new Message(PrivateMessage, name_obj, (Session *) NULL,
+                                 msg);
+      return;
+   }
+
+   ResetIdle(10);
+   if (recipients.Count() == 1) {
+      session = Slot(recipients.Next(0));
+      print("(message sent to %s.)\n", session->name);
+      last_message = new Message(PrivateMessage, name_obj, session, msg);
+      Journal::Log(last_message);
+      session->Enqueue(last_message);
+      return;
+   }
+
+   // Several recipients, listed by name and identity in the shared message.
+   p = list = new char[recipients.Count() * NameLen];
+   q = ids = new char[recipients.Count() * IdentityLen];
+   output("(message sent to ");
+   for (i = recipients.Next(0); i >= 0; i = recipients.Next(i + 1)) {
+      session = Slot(i);
+      if (p > list) {
+         *p++ = '\n';
+         *q++ = '\n';
+         output(", ");
+      }
+      strcpy(p, session->name_only);
+      p += strlen(p);
+      strcpy(q, session->identity);
+      q += strlen(q);
+      output(session->name);
+   }
+   print(".) [%d people]\n", recipients.Count());
+   last_message = new Message(PrivateMessage, name_obj, list, msg, 0, NULL,
+                              ids);
+   delete[] list;
+   delete[] ids;
+   Journal::Log(last_message);
+   for (i = recipients.Next(0); i >= 0; i = recipients.Next(i + 1)) {
+      Slot(i)->Enqueue(last_message);
+   }
 }
 
-// Exit if shutting down and no users are left.
+// Send message to the other members of a channel.
+void Session::SendChannel(const char *name, const char *msg)
+{
+   Channel *channel;
+   Session *session;
+   char buf[SendlistLen];
+   int i, sent = 0;
+
+   // XXX kludge
+   for (i = 0; name[i] && i < SendlistLen - 1; i++) {
+      buf[i] = name[i] == UnquotedUnderscore ? Underscore : name[i];
+   }
+   buf[i] = 0;
+
+   if (!(channel = Channel::Find(buf)) || !channel->members.In(slot)) {
+      print("\a\aYou are not in #%s. (message not sent)\n", buf);
+      return;
+   }
+   last_message = new Message(ChannelMessage, name_obj, channel->name, msg);
+   Journal::Log(last_message);
+   for (i = channel->members.Next(0); i >= 0;
+        i = channel->members.Next(i + 1)) {
+      if (i == slot || !(session = Slot(i))) continue;
+      session->Enqueue(last_message);
+      sent++;
+   }
+
+   if (!sent) {
+      print("\a\aThere is no one else in #%s! (message not sent)\n",
+            channel->name);
+   } else {
+      ResetIdle(10);			// reset idle time
+      print("(message sent to #%s.) [%d %s]\n", channel->name, sent,
+            sent == 1 ? "person" : "people");
+   }
+}
+
+// Exit if shutting down and no users are left, or upgrade if requested.
 void Session::CheckShutdown()
 {
+   if (Upgrade) {
+      Upgrade = false;
+      UpgradeServer();
+      return;
+   }
    if (!Shutdown || sessions) return;
    if (Shutdown > 2) {
       log_message("All connections closed, restarting.");
@@ -12,24 +12,38 @@
 #define _SESSION_H 1
 
 // Include files.
+#include "bitset.h"
+#include "journal.h"
 #include "list.h"
 #include "object.h"
 #include "outbuf.h"
 #include "output.h"
 #include "outstr.h"
 #include "phoenix.h"
+#include "presence.h"
 #include "set.h"
+#include "timer.h"
 
 // Data about a particular session.
 class Session: public Object {
 protected:
    static Pointer<Session> sessions;	// List of all sessions. (global)
+   static Bitset slots;			// Session slots in use. (global)
+   static Session **slot_table;		// Sessions by slot. (global)
+   static int slot_table_size;		// Size of slot table.
 public:
    Pointer<Session> next;		// next session
    Pointer<User> user;			// user this session belongs to
-   Pointer<Telnet> telnet;		// telnet connection for this session
+   Pointer<Telnet> telnet;		// connections, most recently used first
    InputFuncPtr InputFunc;		// function pointer for input processor
    Pointer<Line> lines;			// unprocessed input lines
+   int queued;				// number of unprocessed input lines
+   int tokens;				// input flood control tokens
+   long long token_stamp;		// tick tokens were last refilled
+   int bot_tokens;			// flood control tokens, binary input
+   long long bot_token_stamp;		// tick bot tokens were last refilled
+   bool flooding;			// discarding input lines?
+   MemberTimer<Session> release;	// input flood control timer
    OutputBuffer OutBuf;			// temporary output buffer
    OutputStream Pending;		// pending output stream
    time_t login_time;			// time logged in
@@ -42,20 +56,36 @@ public:
    char name[NameLen];			// current user name (pseudo) with blurb
    char blurb[NameLen];			// current user blurb
    Pointer<Name> name_obj;		// current name object.
+   char identity[IdentityLen];		// stable identity, for message history
    char default_sendlist[SendlistLen];	// current default sendlist
    char last_sendlist[SendlistLen];	// last explicit sendlist
    char reply_sendlist[SendlistLen];	// reply sendlist for last sender
    Pointer<Message> last_message;	// last message sent
+   unsigned long long resume;		// keyed hash of resume token (0 = none)
+   int slot;				// slot for channel membership (or -1)
 
    Session(Telnet *t);			// constructor
    ~Session();				// destructor
    void Close(bool drain = true);	// Close session.
    void Attach(Telnet *t);
-   void Detach(bool intentional);
-   void SaveInputLine(const char *line);
+   void Detach(Telnet *t, bool intentional);
+   void SaveInputLine(const char *line, bool binary = false);
    void SetInputFunction(InputFuncPtr input);
+   bool TakeToken(bool binary = false); // Take input token, if available.
+   void ProcessLines();			// Process input lines, within limits.
    void InitInputFunction();
-   void Input(const char *line);
+   void Input(Telnet *t, const char *line);
+   void Save(Handoff &h);		// Save session state for handoff.
+   void Restore(Handoff &h, Pointer<Session> *list, int n);
+   static void SaveAll(Handoff &h);	// Save all sessions for handoff.
+   static void RestoreAll(Handoff &h);	// Restore all sessions.
+   static int Index(Session *session);	// Position of session in list.
+   static Session *Identified(const char *id, const char *name);
+   void TakeSlot(int i = -1);		// Take (lowest free) session slot.
+   void FreeSlot();			// Free session slot, leave channels.
+   static Session *Slot(int i) {	// Session in slot, if any.
+      return i >= 0 && i < slot_table_size ? slot_table[i] : NULL;
+   }
 
    void output(int byte) {		// queue output byte
       OutBuf.out(byte);
@@ -82,9 +112,19 @@ public:
          session->Enqueue(out);
       }
    }
-   void AcknowledgeOutput(void) {	// Output acknowledgement.
-      Pending.Acknowledge();
+   static void EnqueueAll(Output *out) { // Enqueue output to everyone.
+      Pointer<Output> keep(out);
+      Session *session;
+      for (session = sessions; session; session = session->next) {
+         session->Enqueue(out);
+      }
+   }
+   void Notify(Output *out) {		// Journal notification, tell others.
+      Pointer<Output> keep(out);
+      Journal::Log(out);
+      if (!Presence::Collect(out)) EnqueueOthers(out);
    }
+   void AcknowledgeOutput(Telnet *t);	// Output acknowledgement.
    bool OutputNext(Telnet *telnet) {	// Output next output block.
       return Pending.SendNext(telnet);
    }
@@ -93,35 +133,52 @@ public:
    void Login(const char *line);	// Process response to login prompt.
    void Password(const char *line);	// Process response to password prompt.
    void DoName(const char *line);	// Process response to name prompt.
+   bool DoResume(const char *token);	// Resume session by token.
    void Blurb(const char *line);	// Process response to blurb prompt.
    void ProcessInput(const char *line);	// Process normal input.
+   void SetIdentity();			// Choose stable identity at sign-on.
    void NotifyEntry();			// Notify other users of entry and log.
    void NotifyExit();			// Notify other users of exit and log.
    int ResetIdle(int min);		// Reset/return idle time, maybe report.
    void DoRestart(const char *args);	// Do !restart command.
    void DoDown(const char *args);	// Do !down command.
    void DoNuke(const char *args);	// Do !nuke command.
+   void DoUpgrade();			// Do !upgrade command.
    void DoBye();			// Do /bye command.
    void DoClear();			// Do /clear command.
    void DoDetach();			// Do /detach command.
    void DoWho();			// Do /who command.
+   void DoJoin(const char *args);	// Do /join command.
+   void DoLeave(const char *args);	// Do /leave command.
+   void DoChannels();			// Do /channels command.
    void DoIdle();			// Do /idle command.
    void DoDate();			// Do /date command.
    void DoSignal(const char *p);	// Do /signal command.
+   void DoSplit(const char *p);		// Do /split command.
    void DoSend(const char *p);		// Do /send command.
    void DoWhy();			// Do /why command.
    int DoBlurb(const char *start, bool entry = false); // Do /blurb command.
    void DoHelp();			// Do /help command.
+   void DoReview(const char *args);	// Do /review command.
+   void Reviewed(JournalFetch *fetch);	// Show records fetched for /review.
+   void DoLast(const char *args);	// Do /last command.
+   void DoSearch(const char *args);	// Do /search command.
+   void Searched(JournalFetch *fetch);	// Show records fetched for /search.
+   void Review(Output *out);		// Enqueue reviewed output object.
+   void Review(JournalFetch *fetch);	// Enqueue records fetched.
    void DoReset();			// Do <space><return> idle time reset.
    void DoMessage(const char *line);	// Do message send.
 
    // Send public message to everyone.
    void SendEveryone(const char *msg);
 
-   // Send private message by partial name match.
+   // Send private message by partial name match (and channel members).
    void SendPrivate(const char *sendlist, const char *msg);
 
-   // Exit if shutting down and no users are left.
+   // Send message to channel members.
+   void SendChannel(const char *name, const char *msg);
+
+   // Exit if shutting down and no users are left, or upgrade if requested.
    static void CheckShutdown();
 };
 
@@ -0,0 +1,79 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// sigfd.cc -- Signal class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "fdtable.h"
+#include "phoenix.h"
+#include "sigfd.h"
+
+void Signal::Open()			// Block signals, open signalfd.
+{
+   fdtable.OpenSignal();
+}
+
+Signal::Signal()			// constructor
+{
+   sigset_t mask;
+
+   type = SignalFD;			// Identify as a Signal FD.
+
+   sigemptyset(&mask);
+   sigaddset(&mask, SIGHUP);
+   sigaddset(&mask, SIGQUIT);
+   sigaddset(&mask, SIGTERM);
+   sigaddset(&mask, SIGUSR1);
+
+   // Block before opening, so nothing slips through to default handling.
+   // Threads started later (the journal's) inherit the blocked mask.
+   if (sigprocmask(SIG_BLOCK, &mask, NULL)) {
+      error("Signal::Signal(): sigprocmask()");
+   }
+   if ((fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+      error("Signal::Signal(): signalfd()");
+   }
+}
+
+Signal::~Signal()			// destructor
+{
+   Closed();
+}
+
+void Signal::InputReady()		// Handle pending signals.
+{
+   struct signalfd_siginfo info;
+   int n;
+
+   while ((n = read(fd, &info, sizeof(info))) == sizeof(info)) {
+      switch (info.ssi_signo) {
+      case SIGQUIT:
+      case SIGTERM:
+         Quit();
+         break;
+      case SIGHUP:
+         ReopenLog();
+         break;
+      case SIGUSR1:
+         log_message("Statistics requested by signal.");
+         LogStats();
+         break;
+      }
+   }
+   if (n == -1 && errno != EAGAIN && errno != EINTR) {
+      warn("Signal::InputReady(): read(fd = %d)", fd);
+   }
+}
+
+void Signal::Closed()			// Connection is closed.
+{
+   if (fd == -1) return;		// Skip the rest if already closed.
+   fdtable.Closed(fd);			// Remove from FDTable.
+   close(fd);				// Close signalfd.
+   NoReadSelect();			// Don't select closed descriptors!
+   fd = -1;				// Signalfd is closed.
+}
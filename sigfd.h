@@ -0,0 +1,36 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// sigfd.h -- Signal class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _SIGFD_H
+#define _SIGFD_H 1
+
+// Include files.
+#include "fd.h"
+#include "fdtable.h"
+#include "phoenix.h"
+
+// Signals delivered through a signalfd (subclass of FD).
+//
+// The handled signals are blocked, so they never interrupt anything; they
+// are read from the signalfd by the main loop like any other input, and
+// handled synchronously where it's safe to log, announce and allocate.
+class Signal: public FD {
+public:
+   static void Open();			// Block signals, open signalfd.
+   Signal();				// constructor
+   ~Signal();				// destructor
+   void InputReady();			// Handle pending signals.
+   void OutputReady() {			// Output ready on file descriptor fd.
+      error("Signal::OutputReady(fd = %d): invalid operation!", fd);
+   }
+   void Closed();			// Connection is closed.
+};
+
+#endif // sigfd.h
@@ -0,0 +1,129 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// spill.cc -- Spill class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "output.h"
+#include "phoenix.h"
+#include "session.h"
+#include "spill.h"
+
+Spill::Spill()				// constructor
+{
+   fd = -1;
+   size = pos = 0;
+   map = NULL;
+   mapped = 0;
+   buffered = 0;
+   count = 0;
+}
+
+Spill::~Spill()				// destructor
+{
+   if (map) munmap(map, mapped);
+   if (fd != -1) close(fd);
+}
+
+bool Spill::Open()			// Open (anonymous) spill file.
+{
+   static int serial = 0;		// spill file serial number
+   char path[64];
+
+   if (fd != -1) return true;
+   if (mkdir(SPILL_DIR, 0700) && errno != EEXIST) {
+      warn("Spill::Open(): mkdir(%s)", SPILL_DIR);
+      return false;
+   }
+   sprintf(path, "%s/%d.%d", SPILL_DIR, getpid(), ++serial);
+   if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0600)) == -1) {
+      warn("Spill::Open(): open(%s)", path);
+      return false;
+   }
+   unlink(path);			// Nobody else needs to find it.
+   return true;
+}
+
+void Spill::Reset()			// Truncate spill file after reading.
+{
+   if (map) munmap(map, mapped);
+   map = NULL;
+   mapped = 0;
+   size = pos = 0;
+   if (fd != -1 && ftruncate(fd, 0)) warn("Spill::Reset(): ftruncate()");
+}
+
+bool Spill::Write(Output *out)		// Append output object.
+{
+   OutputRecord rec;
+   int len;
+
+   if (!out) return false;
+   out->Save(rec);
+   len = rec.Size();
+   if (buffered + len > BufSize && !Flush()) return false;
+   if (len > BufSize) {			// Too big to stage, write directly.
+      char *p = new char[len];
+      rec.Pack(p);
+      bool ok = Open() && write(fd, p, len) == len;
+      delete[] p;
+      if (!ok) {
+         warn("Spill::Write(): write()");
+         return false;
+      }
+      size += len;
+   } else {
+      rec.Pack(buf + buffered);
+      buffered += len;
+   }
+   count++;
+   return true;
+}
+
+bool Spill::Flush()			// Write out staging buffer.
+{
+   if (!buffered) return true;
+   if (!Open()) return false;
+   if (write(fd, buf, buffered) != buffered) {
+      warn("Spill::Flush(): write()");
+      return false;
+   }
+   size += buffered;
+   buffered = 0;
+   return true;
+}
+
+Output *Spill::Read()			// Read back next output object.
+{
+   OutputRecord rec;
+   Output *out;
+   int len;
+
+   if (!count || !Flush()) return NULL;
+   if (pos >= off_t(mapped)) {		// Remap to cover newly written data.
+      if (map) munmap(map, mapped);
+      map = (char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map == MAP_FAILED) {
+         warn("Spill::Read(): mmap()");
+         map = NULL;
+         mapped = 0;
+         return NULL;
+      }
+      mapped = size;
+   }
+   if (!(len = rec.Unpack(map + pos, mapped - pos))) {
+      warn("Spill::Read(): corrupt record at offset %ld", long(pos));
+      count = 0;
+      Reset();
+      return NULL;
+   }
+   pos += len;
+   out = rec.Load();
+   if (!--count) Reset();
+   return out;
+}
@@ -0,0 +1,44 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// spill.h -- Spill class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _SPILL_H
+#define _SPILL_H 1
+
+// Include files.
+#include "output.h"
+#include "phoenix.h"
+
+// Append-only spill file for output objects which don't fit in memory.
+// Records are appended as packed OutputRecords and read back in order
+// through a read-only mapping of the file; once everything written has
+// been read back, the file is truncated and reused.
+class Spill {
+private:
+   int fd;				// spill file descriptor
+   off_t size;				// bytes written to file
+   off_t pos;				// bytes read back from file
+   char *map;				// mapping of file for reading
+   size_t mapped;			// size of mapping
+   char buf[BufSize];			// staging buffer for writes
+   int buffered;			// bytes in staging buffer
+   int count;				// count of unread records
+
+   bool Open();				// Open (anonymous) spill file.
+   void Reset();			// Truncate spill file after reading.
+public:
+   Spill();				// constructor
+   ~Spill();				// destructor
+   int Count() { return count; }	// Count of unread records.
+   bool Write(Output *out);		// Append output object.
+   bool Flush();			// Write out staging buffer.
+   Output *Read();			// Read back next output object.
+};
+
+#endif // spill.h
@@ -8,24 +8,27 @@
 //
 
 // Include files.
+#include "admit.h"
 #include "fdtable.h"
+#include "handoff.h"
 #include "line.h"
 #include "phoenix.h"
+#include "resume.h"
 #include "session.h"
 #include "telnet.h"
 #include "user.h"
+#include "wrap.h"
 
-void Telnet::LogCaller()		// Log calling host and port.
-{
-   struct sockaddr_in saddr;
-   socklen_t saddrlen = sizeof(saddr);
+#include <zlib.h>
 
-   if (!getpeername(fd, (struct sockaddr *) &saddr, &saddrlen)) {
-      log_message("Accepted connection on fd #%d from %s port %d.", fd,
-                  inet_ntoa(saddr.sin_addr), saddr.sin_port);
-   } else {
-      warn("Telnet::LogCaller(): getpeername()");
-   }
+int Telnet::slow_readers = 0;		// times output backed up
+int Telnet::slow_detached = 0;		// slow readers detached
+
+// Log calling host and port.
+void Telnet::LogCaller(struct sockaddr_in &saddr)
+{
+   log_message("Accepted connection on fd #%d from %s port %d.", fd,
+               inet_ntoa(saddr.sin_addr), saddr.sin_port);
 }
 
 void Telnet::output(int byte)		// queue output byte
@@ -107,17 +110,26 @@ void Telnet::print(const char *format, ...) // formatted write
 
 void Telnet::echo(int byte)		// echo output byte
 {
-   if (Echo == TelnetEnabled && DoEcho && !undrawn) output(byte);
+   if (Echo == TelnetEnabled && DoEcho) {
+      if (!undrawn) output(byte);
+      else stale = true;		// Redraw split-screen input later.
+   }
 }
 
 void Telnet::echo(const char *buf)	// echo output data
 {
-   if (Echo == TelnetEnabled && DoEcho && !undrawn) output(buf);
+   if (Echo == TelnetEnabled && DoEcho) {
+      if (!undrawn) output(buf);
+      else stale = true;		// Redraw split-screen input later.
+   }
 }
 
 void Telnet::echo(const char *buf, int len) // echo output data (with length)
 {
-   if (Echo == TelnetEnabled && DoEcho && !undrawn) output(buf, len);
+   if (Echo == TelnetEnabled && DoEcho) {
+      if (!undrawn) output(buf, len);
+      else stale = true;		// Redraw split-screen input later.
+   }
 }
 
 void Telnet::echo_print(const char *format, ...) // formatted echo
@@ -125,7 +137,11 @@ void Telnet::echo_print(const char *format, ...) // formatted echo
    char buf[BufSize];
    va_list ap;
 
-   if (Echo == TelnetEnabled && DoEcho && !undrawn) {
+   if (Echo == TelnetEnabled && DoEcho) {
+      if (undrawn) {
+         stale = true;			// Redraw split-screen input later.
+         return;
+      }
       va_start(ap, format);
       (void) vsprintf(buf, format, ap);
       va_end(ap);
@@ -174,10 +190,10 @@ void Telnet::TimingMark(void)		// Queue TIMING-MARK telnet option.
 }
 
 void Telnet::PrintMessage(OutputType type, time_t time, Name *from,
-                          const char *start)
+                          const char *sendlist, const char *text,
+                          Wrap *layout)
 {
-   const char *wrap, *p;
-   int col;
+   int i;
 
    switch (type) {
    case PublicMessage:
@@ -191,7 +207,24 @@ void Telnet::PrintMessage(OutputType type, time_t time, Name *from,
 
       // Print message header.
       if (session->SignalPrivate) output(Bell);
-      print("\n >> Private message from %s:", from->name);
+      print("\n >> Private message from %s", from->name);
+      if (sendlist && strchr(sendlist, '\n')) {
+         // Several recipients, list them all.
+         output(" to ");
+         for (; *sendlist; sendlist++) {
+            if (*sendlist == '\n') {
+               output(", ");
+            } else {
+               output(*sendlist);
+            }
+         }
+      }
+      output(Colon);
+      break;
+   case ChannelMessage:
+      // Print message header.
+      if (session->SignalPublic) output(Bell);
+      print("\n -> From %s to #%s:", from->name, sendlist);
       break;
    default:
       log_message("Internal error! (%s:%d)\n", __FILE__, __LINE__);
@@ -201,46 +234,22 @@ void Telnet::PrintMessage(OutputType type, time_t time, Name *from,
    // Print timestamp. (XXX make optional?)
    print(" [%s]\n - ", date(time, 11, 5)); // XXX assumes within last day
 
-   while (*start) {
-      wrap = NULL;
-
-      for (p = start, col = 0; *p && col < width - 4; p++, col++) {
-         if (*p == Space) wrap = p;
-      }
-      if (!*p) {
-         output(start, p - start);
-         break;
-      } else if (wrap) {
-         output(start, wrap - start);
-         start = wrap + 1;
-         if (*start == Space) start++;
-      } else {
-         output(start, p - start);
-         start = p;
-      }
-      output("\n - ");
+   for (i = 0; i < layout->lines; i++) {
+      if (i) output("\n - ");
+      output(text + layout->start[i], layout->length[i]);
    }
    output(Newline);
 }
 
+// Send the welcome banner and login prompt right away.  Option negotiations
+// are still outstanding, so assume a raw TCP client until the client proves
+// otherwise: no server echo until it agrees to ECHO, and no Go Aheads unless
+// it actually refuses SUPPRESS-GO-AHEAD.
 void Telnet::Welcome()
 {
-   // Make sure we're done with initial option negotiations.
-   // Intentionally use == with bitfield mask to test both bits at once.
-   if (LSGA == TelnetWillWont) return;
-   if (RSGA == TelnetDoDont) return;
-   if (Echo == TelnetWillWont) return;
-
    // Send welcome banner, announce guest account.
    output("\nWelcome to Phoenix!\n\nA \"guest\" account is available.\n\n");
 
-   // Let's hope the SUPPRESS-GO-AHEAD option worked.
-   if (!LSGA && !RSGA) {
-      // Sigh.  Couldn't suppress Go Aheads.  Inform the user.
-      output("Sorry, unable to suppress Go Aheads.  Must operate in half-"
-             "duplex mode.\n\n");
-   }
-
    // Warn if about to shut down!
    if (Shutdown) output("*** This server is about to shut down! ***\n\n");
 
@@ -251,6 +260,81 @@ void Telnet::Welcome()
    session->InitInputFunction();
 }
 
+void Telnet::SetIdleTimer()		// Restart login or idle timer.
+{
+   if (!session || !session->SignedOn) {
+      if (!idle.IsSet()) idle.Set(LoginTimeout);
+   } else if (IdleTimeout) {
+      idle.Set(IdleTimeout);
+   } else {
+      idle.Cancel();
+   }
+}
+
+void Telnet::IdleTimedOut()		// Login or idle timer expired.
+{
+   Pointer<Telnet> keep(this);
+
+   if (fd == -1 || closing || !session) return;
+   if (session->SignedOn && !IdleTimeout) return; // Logged in, never idle.
+   if (!session->SignedOn) {
+      log_message("Login timed out on fd #%d.", fd);
+      output("\nLogin timed out!\n");
+   } else {
+      log_message("Idle timeout for %s (%s) on fd #%d.",
+                  session->name_only, (char *) session->user->user, fd);
+      output("\nIdle timeout, detaching session.\n");
+   }
+   Close();
+}
+
+// Flag connection as a slow reader, once its session's output stream is
+// backing up too.  Cleared once the backlog is acknowledged.
+void Telnet::SlowReader()
+{
+   if (slow) return;
+   slow = true;
+   slow_readers++;
+   if (slow_count++) return;		// Only log the first time.
+   if (session && session->SignedOn) {
+      log_message("Slow reader: %s (%s) on fd #%d, %d KB queued.",
+                  session->name_only, (char *) session->user->user, fd,
+                  Output.blocks * BlockSize / 1024);
+   } else {
+      log_message("Slow reader on fd #%d, %d KB queued.", fd,
+                  Output.blocks * BlockSize / 1024);
+   }
+}
+
+void Telnet::ResumeOutput()		// Resume output held at high mark.
+{
+   held = false;
+   if (session && acknowledge) while (session->OutputNext(this)) ;
+}
+
+// Unread output is past the hard limit; detach the session, keeping its
+// output for review.  Runs from a timer, since the limit is noticed in the
+// middle of sending output to everyone.
+void Telnet::DetachSlowReader()
+{
+   if (fd == -1 || closing) return;
+   slow_detached++;
+   if (session && session->SignedOn) {
+      log_message("Slow reader: %s (%s) on fd #%d, detaching. (behind %d "
+                  "time%s)", session->name_only, (char *) session->user->user,
+                  fd, slow_count, slow_count == 1 ? "" : "s");
+   } else {
+      log_message("Slow reader on fd #%d, closing.", fd);
+   }
+   Close(false);
+}
+
+void Telnet::LogStats()			// Log slow reader statistics.
+{
+   log_message("Output held for %d slow reader%s, %d detached.",
+               slow_readers, slow_readers == 1 ? "" : "s", slow_detached);
+}
+
 // Set telnet ECHO option. (local)
 void Telnet::set_Echo(CallbackFuncPtr callback, int state)
 {
@@ -290,38 +374,288 @@ void Telnet::set_RSGA(CallbackFuncPtr callback, int state)
    RSGA_callback = callback;		// save callback function
 }
 
-Telnet::Telnet(int lfd)			// Telnet constructor.
+void Telnet::EchoInput(bool on)		// Echo input, or hide it.
+{
+   DoEcho = on;
+
+   // A client editing lines locally echoes them itself.  Claim the ECHO
+   // option to keep it from echoing a password.
+   if (edit) set_Echo(NULL, !on);
+}
+
+// Client editing lines locally, or not.  The server only echoes input it
+// edits itself.
+void Telnet::LineEdit(bool on)
+{
+   if (on == edit) return;
+   edit = on;
+   if (DoEcho) set_Echo(NULL, !on);
+}
+
+// Process NEW-ENVIRON variables sent by the client.  Only RESUME matters:
+// a valid resume token at the login prompt re-attaches its session, just as
+// if "resume <token>" had been typed.
+void Telnet::Environment()
+{
+   char var[SubnegotiationSize], value[SubnegotiationSize];
+   char *p = NULL, *v = NULL;
+   int i;
+
+   // A VALUE only counts once a VAR has named it; anything before the
+   // first VAR is skipped.
+   var[0] = value[0] = 0;
+   for (i = 2; i <= sb_len; i++) {
+      if (i == sb_len || sb[i] == EnvironVar || sb[i] == EnvironUservar) {
+         if (p) *p = 0;			// End of previous variable.
+         if (v && !strcmp(var, "RESUME")) break;
+         p = var;
+         v = NULL;
+      } else if (sb[i] == EnvironValue && p) {
+         *p = 0;
+         p = v = value;
+      } else if (p) {
+         if (sb[i] == EnvironEsc && i + 1 < sb_len) i++;
+         *p++ = sb[i];
+      }
+   }
+   if (i > sb_len || !session || session->InputFunc != &Session::Login ||
+       !Resume::Find(value)) {
+      return;
+   }
+
+   // Abandon the login prompt and any partial input.
+   UndrawInput();
+   if (prompt) {
+      delete prompt;
+      prompt = NULL;
+   }
+   prompt_len = 0;
+   point = free = data;
+   mark = NULL;
+   session->DoResume(value);
+}
+
+void Telnet::Subnegotiation()		// Process received subnegotiation.
+{
+   if (sb_len < 2) return;
+   switch (sb[0]) {
+   case TelnetWindowSize:
+      if (sb_len < 5) break;
+      Resize(sb[1] << 8 | sb[2], sb[3] << 8 | sb[4]);
+      break;
+   case TelnetNewEnviron:
+      if (sb[1] == EnvironIs || sb[1] == EnvironInfo) Environment();
+      break;
+   case TelnetLinemode:
+      if (Linemode != TelnetEnabled) break;
+      switch (sb[1]) {
+      case LinemodeMode:
+         if (sb_len < 3) break;
+         if (!(sb[2] & LinemodeModeAck) && (sb[2] & LinemodeEdit) != edit) {
+            // Client asked for another mode; agree to it.
+            const char mode[] = {
+               (char) TelnetIAC, (char) TelnetSubnegotiationBegin,
+               TelnetLinemode, LinemodeMode,
+               (char) ((sb[2] & LinemodeEdit) | LinemodeModeAck),
+               (char) TelnetIAC, (char) TelnetSubnegotiationEnd
+            };
+            command(mode, sizeof(mode));
+         }
+         LineEdit(sb[2] & LinemodeEdit);
+         break;
+      case TelnetDo:
+      case TelnetWill:
+         // Refuse FORWARDMASK; lines are only forwarded at end of line.
+         if (sb_len < 3) break;
+         {
+            const char refuse[] = {
+               (char) TelnetIAC, (char) TelnetSubnegotiationBegin,
+               TelnetLinemode,
+               (char) (sb[1] == TelnetDo ? TelnetWont : TelnetDont),
+               (char) sb[2],
+               (char) TelnetIAC, (char) TelnetSubnegotiationEnd
+            };
+            command(refuse, sizeof(refuse));
+         }
+         break;
+      default:
+         // Ignore SLC; the client keeps its own editing characters.
+         break;
+      }
+      break;
+   }
+}
+
+void Telnet::Resize(int w, int h)	// Set screen size. (0 = unknown)
+{
+   if (w) width = w < MinWidth ? MinWidth : w;
+   if (h) height = h < MinHeight ? MinHeight : h;
+
+   // Fit the split-screen scroll region to the new height.
+   if (!split) return;
+   if (split_rows > height - 2) split_rows = height - 2;
+   print("\033[1;%dr", height - split_rows); // XXX ANSI!
+   if (undrawn) {			// Carry on with output.
+      print("\033[%d;1H", height - split_rows); // XXX ANSI!
+      stale = true;
+   } else {
+      DrawInput();
+   }
+}
+
+// Compressed output (MCCP2) starts right after IAC SB COMPRESS2 IAC SE is
+// sent, so note how much command output must still go out uncompressed.
+void Telnet::QueueCompress()		// Queue start of compressed output.
+{
+   const char start[] = {
+      (char) TelnetIAC, (char) TelnetSubnegotiationBegin, TelnetCompress2,
+      (char) TelnetIAC, (char) TelnetSubnegotiationEnd
+   };
+   Block *block;
+
+   if (zout || zstart) return;		// Already compressing, or about to.
+   command(start, sizeof(start));
+   for (block = Command.head; block; block = block->next) {
+      zstart += block->free - block->data;
+   }
+}
+
+void Telnet::StartCompress()		// Start compressing output.
+{
+   zstart = 0;
+   zout = new z_stream;
+   memset(zout, 0, sizeof(z_stream));
+   if (deflateInit2(zout, CompressLevel, Z_DEFLATED, CompressWindowBits,
+                    CompressMemLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+      warn("Telnet::StartCompress(): deflateInit2() failed");
+      delete zout;
+      zout = NULL;
+   }
+}
+
+// Run compressor until its input is used up and its output is flushed as
+// asked, appending the compressed data to out.
+static void RunDeflate(z_stream *z, OutputBuffer &out, int flush)
+{
+   do {
+      if (!out.tail) {
+         out.head = out.tail = new Block;
+         out.blocks++;
+      } else if (out.tail->free >= out.tail->block + BlockSize) {
+         out.tail->next = new Block;
+         out.tail = out.tail->next;
+         out.blocks++;
+      }
+      z->next_out = (Bytef *) out.tail->free;
+      z->avail_out = out.tail->block + BlockSize - out.tail->free;
+      deflate(z, flush);
+      out.tail->free = (char *) z->next_out;
+   } while (z->avail_in || !z->avail_out);
+}
+
+// Compress up to max bytes of buffered output into Deflated, then flush the
+// compressor as asked.  Returns the number of bytes compressed.
+int Telnet::Deflate(OutputBuffer &buf, int max, int flush)
+{
+   Block *block;
+   int n = 0;
+
+   while (n < max && (block = buf.head)) {
+      zout->next_in = (Bytef *) block->data;
+      zout->avail_in = block->free - block->data;
+      n += zout->avail_in;
+      RunDeflate(zout, Deflated, Z_NO_FLUSH);
+      if (block->next) {
+         buf.head = block->next;
+      } else {
+         buf.head = buf.tail = NULL;
+      }
+      buf.blocks--;
+      delete block;
+      if (&buf == &Output && held && Output.blocks <= OutputLowMark) {
+         ResumeOutput();
+      }
+   }
+   if (flush != Z_NO_FLUSH) {
+      zout->avail_in = 0;
+      RunDeflate(zout, Deflated, flush);
+   }
+   return n;
+}
+
+// Finish the compressed stream, compressing all queued output first.  The
+// client carries on uncompressed after the end of the stream.
+void Telnet::EndCompress()
+{
+   if (!zout) return;
+   Deflate(Command, INT_MAX, Z_NO_FLUSH);
+   Deflate(Output, INT_MAX, Z_FINISH);
+   deflateEnd(zout);
+   delete zout;
+   zout = NULL;
+   if (Deflated.head) WriteSelect();
+}
+
+void Telnet::Init()			// Initialize connection state.
 {
    type = TelnetFD;			// Identify as a Telnet FD.
    session = NULL;			// no Session (yet)
+   addr = 0;				// no caller address (yet)
    data = new char[InputSize];		// Allocate input line buffer.
    end = data + InputSize;		// Save end of allocated block.
    point = free = data;			// Mark input line as empty.
    mark = NULL;				// No mark set initially.
+   unread = NULL;			// No unprocessed input.
+   unread_len = unread_pos = 0;
+   line_budget = LineBudget;		// Full line budget.
    prompt = NULL;			// No prompt initially.
    prompt_len = 0;			// Length of prompt
    state = 0;				// telnet input state = 0 (data)
+   sb_len = 0;				// no subnegotiation received
    reply_to = NULL;			// No last sender.
+   sent = NULL;				// No output objects sent.
+   Sent = Acknowledged = 0;
    outstanding = 0;			// No outstanding acknowledgements.
    undrawn = false;			// Input line not undrawn.
+   split = false;			// Input line not pinned.
+   stale = false;
+   split_rows = 1;
    blocked = false;			// output not blocked
    closing = false;			// connection not closing
+   dirty = false;			// no output objects waiting
+   held = false;			// output not held
+   slow = false;			// not a slow reader
+   slow_count = 0;
    acknowledge = false;			// Test TIMING-MARK option before use.
    DoEcho = true;			// Do echoing, if ECHO option enabled.
+   edit = false;			// Server edits input lines.
    Echo = 0;				// ECHO option off (local)
+   Linemode = 0;			// LINEMODE option off (remote)
+   NAWS = 0;				// NAWS option off (remote)
+   Environ = 0;				// NEW-ENVIRON option off (remote)
+   Compress2 = 0;			// COMPRESS2 option off (local)
+   zout = NULL;				// Output not compressed.
+   zstart = 0;
+   width = DefaultWidth;		// Assume default screen size.
+   height = DefaultHeight;
    LSGA = 0;				// local SUPPRESS-GO-AHEAD option off
    RSGA = 0;				// remote SUPPRESS-GO-AHEAD option off
    Echo_callback = NULL;		// no ECHO callback (local)
    LSGA_callback = NULL;		// no local SUPPRESS-GO-AHEAD callback
    RSGA_callback = NULL;		// no remote SUPPRESS-GO-AHEAD callback
+   fd = -1;				// no connection (yet)
+}
 
-   fd = accept(lfd, NULL, NULL);	// Accept TCP connection.
-   if (fd == -1) return;		// Return if failed.
-
-   if (fcntl(fd, F_SETFD, 0) == -1) error("Telnet::Telnet(): fcntl()");
+// Telnet constructor, for a (non-blocking) connection accepted by Listen.
+Telnet::Telnet(int sock, struct sockaddr_in &saddr):
+   idle(this, &Telnet::IdleTimedOut),
+   overflow(this, &Telnet::DetachSlowReader)
+{
+   Init();				// Initialize connection state.
 
-   LogCaller();				// Log calling host and port.
-   NonBlocking();			// Place fd in non-blocking mode.
+   fd = sock;				// Save accepted TCP connection.
+   LogCaller(saddr);			// Log calling host and port.
+   if (Admission::Attach(saddr.sin_addr.s_addr)) addr = saddr.sin_addr.s_addr;
 
    session = new Session(this);		// Create a new Session.
 
@@ -330,19 +664,198 @@ Telnet::Telnet(int lfd)			// Telnet constructor.
    // Test TIMING-MARK option before sending initial option negotions.
    command(TelnetIAC, TelnetDo, TelnetTimingMark);
 
-   set_LSGA(&Telnet::Welcome, true);	// Start initial options negotiations.
-   set_RSGA(&Telnet::Welcome, true);
-   set_Echo(&Telnet::Welcome, true);
+   set_LSGA(NULL, true);		// Start initial options negotiations.
+   set_RSGA(NULL, true);
+   set_Echo(NULL, true);
+
+   // Offer line mode, so capable clients can edit input lines locally.
+   Linemode |= TelnetDoDont;
+   command(TelnetIAC, TelnetDo, TelnetLinemode);
+
+   // Ask for window size and offer compression.
+   NAWS |= TelnetDoDont;
+   command(TelnetIAC, TelnetDo, TelnetWindowSize);
+   Compress2 |= TelnetWillWont;
+   command(TelnetIAC, TelnetWill, TelnetCompress2);
+
+   // Ask for environment, for a resume token to get straight back in with.
+   Environ |= TelnetDoDont;
+   command(TelnetIAC, TelnetDo, TelnetNewEnviron);
+
+   Welcome();				// Don't wait for replies.
+   SetIdleTimer();			// Start login timer.
+}
+
+Telnet::Telnet():			// Telnet constructor. (handed-off)
+   idle(this, &Telnet::IdleTimedOut),
+   overflow(this, &Telnet::DetachSlowReader)
+{
+   Init();				// Initialize, then wait for Restore().
+}
+
+void Telnet::Save(Handoff &h)		// Save connection state for handoff.
+{
+   EndCompress();			// Compressor state can't be handed off.
+   saved = true;
+   h.PutInt(fd);
+   h.PutInt(addr);
+   h.PutInt(end - data);
+   h.PutInt(free - data);
+   h.Put(data, free - data);
+   h.PutInt(point - data);
+   h.PutInt(mark ? mark - data : -1);
+   h.PutInt(unread_len - unread_pos);
+   h.Put(unread + unread_pos, unread_len - unread_pos);
+   h.PutString(prompt);
+   h.PutString(reply_to ? reply_to->name : (char *) NULL);
+   h.PutInt(Session::Index(reply_to ? (Session *) reply_to->session : NULL));
+   h.PutBuffer(Output);
+   h.PutBuffer(Command);
+   h.PutBuffer(Deflated);
+   h.PutInt(zstart);
+   h.PutInt(outstanding);
+   h.PutInt(state);
+   h.PutInt(sb_len);
+   h.Put(sb, sb_len);
+   h.PutInt(undrawn);
+   h.PutInt(split);
+   h.PutInt(stale);
+   h.PutInt(split_rows);
+   h.PutInt(blocked);
+   h.PutInt(closing);
+   h.PutInt(acknowledge);
+   h.PutInt(DoEcho);
+   h.PutInt(edit);
+   h.PutInt(Echo);
+   h.PutInt(Linemode);
+   h.PutInt(NAWS);
+   h.PutInt(Environ);
+   h.PutInt(Compress2);
+   h.PutInt(width);
+   h.PutInt(height);
+   h.PutInt(LSGA);
+   h.PutInt(RSGA);
+}
+
+// Restore connection state from handoff, for session s.
+void Telnet::Restore(Handoff &h, Session *s, Pointer<Session> *list, int n)
+{
+   char *name;
+   int size, used, i;
+
+   session = s;
+   fd = h.GetInt();
+   addr = h.GetInt();
+   if (addr && !Admission::Attach(addr)) addr = 0;
+   size = h.GetInt();
+   used = h.GetInt();
+   if (size < InputSize || used < 0 || used > size) {
+      size = InputSize;
+      used = 0;
+   }
+   delete[] data;
+   data = new char[size];
+   end = data + size;
+   h.Get(data, used);
+   free = data + used;
+   point = data + h.GetInt();
+   if (point < data || point > free) point = free;
+   i = h.GetInt();
+   mark = i >= 0 && i <= used ? data + i : NULL;
+   if ((i = h.GetInt()) > 0) {
+      unread = new char[i];
+      if (h.Get(unread, i)) unread_len = i;
+   }
+   prompt = h.GetString();
+   prompt_len = prompt ? strlen(prompt) : 0;
+   name = h.GetString();
+   i = h.GetInt();
+   if (name) {
+      reply_to = new Name(i >= 0 && i < n ? (Session *) list[i] : NULL, NULL,
+                          name);
+      delete[] name;
+   }
+   h.GetBuffer(Output);
+   h.GetBuffer(Command);
+   h.GetBuffer(Deflated);
+   zstart = h.GetInt();
+   outstanding = h.GetInt();
+   state = h.GetInt();
+   sb_len = h.GetInt();
+   if (sb_len < 0 || sb_len > SubnegotiationSize) sb_len = 0;
+   h.Get(sb, sb_len);
+   undrawn = h.GetInt();
+   split = h.GetInt();
+   stale = h.GetInt();
+   split_rows = h.GetInt();
+   blocked = h.GetInt();
+   closing = h.GetInt();
+   acknowledge = h.GetInt();
+   DoEcho = h.GetInt();
+   edit = h.GetInt();
+   Echo = h.GetInt();
+   Linemode = h.GetInt();
+   NAWS = h.GetInt();
+   Environ = h.GetInt();
+   Compress2 = h.GetInt();
+   width = h.GetInt();
+   height = h.GetInt();
+   if (width < MinWidth) width = DefaultWidth;
+   if (height < MinHeight) height = DefaultHeight;
+   if (split_rows < 1 || split_rows > height - 2) split_rows = 1;
+   LSGA = h.GetInt();
+   RSGA = h.GetInt();
+   if (fd == -1 || !h.Ok()) return;
+
+   fdtable.Adopt(this);
+   if (unread_len) {			// Finish deferred input first.
+      Defer();
+   } else {
+      ReadSelect();
+   }
+   if (Output.head || Command.head || Deflated.head) WriteSelect();
+   if (Compress2 == TelnetEnabled) QueueCompress(); // Start a new stream.
+   Dirty();				// Render any unsent output.
+   SetIdleTimer();
+}
+
+// Output objects are rendered once per dispatch pass, in the flush phase,
+// rather than as each is queued: one undraw of the input line, all of the
+// waiting objects, one redraw, then one writev() of the lot.
+void Telnet::Dirty()			// Render output objects in flush phase.
+{
+   if (dirty) return;
+   dirty = true;
+   QueueFlush();
+}
+
+void Telnet::Render()			// Render waiting output objects now.
+{
+   dirty = false;
+   if (!session) return;
+   if (acknowledge) {
+      while (session->OutputNext(this)) ;
+   } else if (!blocked) {		// Raw TCP, or not known yet: fake it.
+      while (session->OutputNext(this)) session->AcknowledgeOutput(this);
+   }
+}
+
+void Telnet::Flush()			// Render and write output now.
+{
+   if (dirty) Render();
+   FD::Flush();
 }
 
 void Telnet::Prompt(const char *p)	// Print and set new prompt.
 {
    session->EnqueueOutput();
+   if (dirty) Render();			// Keep output ahead of prompt.
    prompt_len = strlen(p);
    if (prompt) delete prompt;
    prompt = new char[prompt_len + 1];
    strcpy(prompt, p);
    if (!undrawn) output(prompt);
+   else stale = true;			// Redraw split-screen input later.
 }
 
 Telnet::~Telnet()			// Destructor, might be re-executed.
@@ -352,19 +865,21 @@ Telnet::~Telnet()			// Destructor, might be re-executed.
 
 void Telnet::Close(bool drain)		// Close telnet connection.
 {
+   if (drain && dirty) Render();	// Render final output first.
+   if (drain && split) SplitScreen(false); // Restore normal scrolling.
    closing = true;			// Closing intentionally.
-   if (Output.head && drain) {		// Drain connection, then close.
+   if ((Output.head || Deflated.head) && drain) { // Drain, then close.
       blocked = false;
       DoEcho = false;
       if (acknowledge) {
          TimingMark();			// Send final acknowledgement.
       } else {
-         while (session->OutputNext(this)) session->AcknowledgeOutput();
+         while (session->OutputNext(this)) session->AcknowledgeOutput(this);
       }
       WriteSelect();
 
       // Detach associated session.
-      if (session) session->Detach(closing);
+      if (session) session->Detach(this, closing);
       session = NULL;
    } else {				// No output pending, close immediately.
       fdtable.Close(fd);
@@ -373,14 +888,26 @@ void Telnet::Close(bool drain)		// Close telnet connection.
 
 void Telnet::Closed()			// Connection is closed.
 {
+   idle.Cancel();			// No more timeouts.
+   overflow.Cancel();
+
    // Detach associated session.
-   if (session) session->Detach(closing);
+   if (session) session->Detach(this, closing);
    session = NULL;
 
    // Free input line buffer.
    if (data) delete data;
    data = NULL;
 
+   // Discard unprocessed input.
+   if (unread) delete[] unread;
+   unread = NULL;
+   unread_len = unread_pos = 0;
+
+   // Release caller's connection slot.
+   if (addr) Admission::Release(addr);
+   addr = 0;
+
    if (fd == -1) return;		// Skip the rest if no connection.
 
    fdtable.Closed(fd);			// Remove from FDTable.
@@ -389,6 +916,12 @@ void Telnet::Closed()			// Connection is closed.
    NoWriteSelect();
    Command.~OutputBuffer();		// Destroy command output buffer.
    Output.~OutputBuffer();		// Destroy data output buffer.
+   Deflated.~OutputBuffer();		// Destroy compressed output buffer.
+   if (zout) {				// Discard output compressor.
+      deflateEnd(zout);
+      delete zout;
+      zout = NULL;
+   }
    fd = -1;				// Connection is closed.
 }
 
@@ -398,6 +931,10 @@ void Telnet::UndrawInput()		// Erase input line from screen.
 
    if (undrawn) return;
    undrawn = true;
+   if (split) {				// Leave input; output above it.
+      print("\0337\033[%d;1H", height - split_rows); // XXX ANSI!
+      return;
+   }
    if (Echo == TelnetEnabled && DoEcho) {
       if (!Start() && !End()) return;
       lines = PointLine();
@@ -419,6 +956,14 @@ void Telnet::RedrawInput()		// Redraw input line on screen.
 
    if (!undrawn) return;
    undrawn = false;
+   if (split) {				// Input line is still on screen.
+      if (stale) {
+         DrawInput();
+      } else {
+         output("\0338");		// Restore cursor. XXX ANSI!
+      }
+      return;
+   }
    if (prompt) output(prompt);
    if (End()) {
       echo(data, End());
@@ -436,6 +981,80 @@ void Telnet::RedrawInput()		// Redraw input line on screen.
    }
 }
 
+// Split-screen input keeps the input line pinned at the bottom of the
+// screen, below a DECSTBM scroll region which holds all other output.
+// Output is written at the bottom of the scroll region between a cursor
+// save and restore, so it never needs the input line undrawn or redrawn.
+// The bottom row of the scroll region is always left blank for output.
+bool Telnet::SplitScreen(bool on)	// Pin input line below scroll region.
+{
+   if (on == split) return true;
+   if (on) {
+      if (Echo != TelnetEnabled || !DoEcho) return false;
+      UndrawInput();
+      // XXX ANSI!
+      print("\033[%d;1H\n\033[1;%dr", height, height - 1);
+      split = true;
+      split_rows = 1;
+      stale = true;
+      RedrawInput();
+   } else {
+      // Erase input area, then carry on at the bottom of the scroll region.
+      // XXX ANSI!
+      print("\033[%d;1H\033[J\033[r\033[%d;1H", InputRow(),
+            height - split_rows);
+      split = false;
+      stale = false;
+      undrawn = true;
+      RedrawInput();
+   }
+   return true;
+}
+
+void Telnet::DrawInput()		// Draw split-screen input line afresh.
+{
+   stale = false;
+   FitInput();
+   print("\033[%d;1H\033[J", InputRow()); // XXX ANSI!
+   if (prompt) output(prompt);
+   if (End()) echo(data, End());
+   if (Echo == TelnetEnabled && DoEcho) { // Move cursor to point.
+      echo_print("\033[%d;%dH", InputRow() + PointLine(), PointColumn() + 1);
+   }
+}
+
+void Telnet::FitInput()			// Grow split-screen input area to fit.
+{
+   int rows = EndLine() + 1;
+
+   if (rows > height - 2) rows = height - 2; // Leave a scroll region.
+   if (!split || undrawn || rows <= split_rows) return;
+
+   // Scroll the whole screen up to make room, input area included.
+   print("\033[r\033[%d;1H", height);	// XXX ANSI!
+   for (; split_rows < rows; split_rows++) output(Newline);
+   print("\033[1;%dr\033[%d;%dH", height - split_rows,
+         InputRow() + PointLine(), PointColumn() + 1); // XXX ANSI!
+}
+
+void Telnet::ScrollInput()		// Scroll accepted input into output.
+{
+   // Join the input to the output above it, then scroll the last input row
+   // to just above the bottom of the new scroll region, or close the gap
+   // left below input that has shrunk.
+   int lines = InputRow() - 1 + EndLine() - (height - 2);
+
+   print("\033[r\033[%d;1H\033[M", height - split_rows); // XXX ANSI!
+   if (lines > 0) {
+      print("\033[%d;1H", height);	// XXX ANSI!
+      while (lines--) output(Newline);
+   } else if (lines < 0) {
+      print("\033[%dT", -lines);	// XXX ANSI!
+   }
+   split_rows = 1;
+   print("\033[1;%dr\033[%d;1H", height - 1, height); // XXX ANSI!
+}
+
 inline void Telnet::beginning_of_line()	// Jump to beginning of line.
 {
    int lines, columns;
@@ -517,12 +1136,15 @@ inline void Telnet::accept_input()	// Accept input line.
 
    // Flush any pending output to connection.
    if (!acknowledge) {
-      while (session->OutputNext(this)) session->AcknowledgeOutput();
+      while (session->OutputNext(this)) session->AcknowledgeOutput(this);
    }
 
    if (undrawn) {			// Line undrawn, queue as text output.
       session->output(data);
       session->output(Newline);
+      stale = true;			// Redraw split-screen input later.
+   } else if (split) {			// Scroll line up into output.
+      ScrollInput();
    } else {				// Jump to end of line and echo newline.
       if (!AtEnd()) end_of_line();
       echo(Newline);
@@ -536,7 +1158,8 @@ inline void Telnet::accept_input()	// Accept input line.
    }
    prompt_len = 0;			// Wipe prompt length.
 
-   session->Input(data);		// Call state-specific input processor.
+   line_budget--;			// Count against line budget.
+   session->Input(this, data);		// Call state-specific input processor.
 
    if ((end - data) > InputSize) {	// Drop buffer back to normal size.
       delete data;
@@ -554,6 +1177,7 @@ inline void Telnet::insert_char(int ch)	// Insert character at point.
       // Echo character if necessary.
       if (!AtEnd()) echo("\033[@");	// XXX ANSI!
       echo(ch);
+      if (split) FitInput();		// Wrapped onto a new screen row?
    } else {
       output(Bell);
    }
@@ -622,15 +1246,40 @@ inline void Telnet::transpose_chars()	// Exchange two characters at point.
    }
 }
 
-void Telnet::InputReady()		// Telnet stream can input data.
+// Telnet stream can input data, or has deferred input left to process.
+//
+// Each call handles at most ReadBudget bytes and LineBudget input lines, so
+// one client flooding input can't hold up everyone else.  Input left over
+// once the line budget is used up is kept unprocessed, and the connection
+// goes on the ready queue for another turn after every other connection
+// has had one.  Until the leftover input is processed, no more is read,
+// so a flood backs up into the sender's TCP window instead of memory.
+void Telnet::InputReady()
 {
-   char buf[BufSize];
-   Block *block;
-   register const char *from, *from_end;
-   register int n;
+   char buf[ReadBudget];
+   int n, used;
 
    if (fd == -1) return;
-   n = read(fd, buf, BufSize);
+   deferred = false;
+
+   // Process deferred input first.
+   if (unread) {
+      unread_pos += Receive(unread + unread_pos, unread_len - unread_pos);
+      if (fd == -1) return;
+      if (unread_pos < unread_len) {
+         Defer();
+      } else {
+         delete[] unread;
+         unread = NULL;
+         unread_len = unread_pos = 0;
+         if (!closing) ReadSelect();	// Ready for more input now.
+      }
+      if (closing && !outstanding && !Command.head && !Output.head &&
+          !Deflated.head) Closed();
+      return;
+   }
+
+   n = read(fd, buf, ReadBudget);
    switch (n) {
    case -1:
       switch (errno) {
@@ -654,308 +1303,460 @@ void Telnet::InputReady()		// Telnet stream can input data.
       Closed();
       return;
    default:
-      from = buf;
-      from_end = buf + n;
-      while (from < from_end) {
-         // Make sure there's room for more in the buffer.
-         if (free >= end) {
-            n = end - data;
-            char *tmp = new char[n + InputSize];
-            strncpy(tmp, data, n);
-            point = tmp + (point - data);
-            if (mark) mark = tmp + (mark - data);
-            free = tmp + n;
-            end = free + InputSize;
-            delete data;
-            data = tmp;
-         }
-         n = *((unsigned const char *) from++);
-         switch (state) {
-         case TelnetIAC:
-            switch (n) {
-            case TelnetAbortOutput:
-               // Abort all output data.
-               while (Output.head) {
-                  block = Output.head;
-                  Output.head = block->next;
-                  delete block;
-               }
-               Output.tail = NULL;
-               state = 0;
-               break;
-            case TelnetAreYouThere:
-               // Are we here?  Yes!  Queue confirmation to command queue,
-               // to be output as soon as possible.  (Does NOT wait on a
-               // Go Ahead if output is blocked!)
-               command("\r\n[Yes]\r\n");
-               state = 0;
-               break;
-            case TelnetEraseCharacter:
-               // Erase last input character.
-               erase_char();
-               state = 0;
-               break;
-            case TelnetEraseLine:
-               // Erase current input line.
-               erase_line();
-               state = 0;
-               break;
-            case TelnetGoAhead:
-               // Unblock output.
-               if (Output.head) WriteSelect();
-               blocked = false;
-               state = 0;
-               break;
-            case TelnetWill:
-            case TelnetWont:
-            case TelnetDo:
-            case TelnetDont:
-               // Options negotiation.  Remember which type.
-               state = n;
-               break;
-            case TelnetIAC:
-               // Escaped (doubled) TelnetIAC is data.
-               insert_char(TelnetIAC);
-               state = 0;
-               break;
-            default:
-               // Ignore any other telnet command.
-               state = 0;
-               break;
+      SetIdleTimer();			// Not idle now.
+      used = Receive(buf, n);
+      if (fd == -1) return;
+      if (used < n) {			// Line budget used up, defer the rest.
+         unread_len = n - used;
+         unread_pos = 0;
+         unread = new char[unread_len];
+         memcpy(unread, buf + used, unread_len);
+         NoReadSelect();
+         Defer();
+      }
+      break;
+   }
+   if (closing && !outstanding && !Command.head && !Output.head &&
+          !Deflated.head) Closed();
+}
+
+// Process received input, up to the line budget.  Returns bytes consumed.
+int Telnet::Receive(const char *buf, int len)
+{
+   Block *block;
+   register const char *from, *from_end;
+   register int n;
+
+   line_budget = LineBudget;		// Fresh line budget.
+   from = buf;
+   from_end = buf + len;
+   while (from < from_end && line_budget > 0 && fd != -1) {
+      // Make sure there's room for more in the buffer.
+      if (free >= end) {
+         n = end - data;
+         char *tmp = new char[n + InputSize];
+         strncpy(tmp, data, n);
+         point = tmp + (point - data);
+         if (mark) mark = tmp + (mark - data);
+         free = tmp + n;
+         end = free + InputSize;
+         delete data;
+         data = tmp;
+      }
+      n = *((unsigned const char *) from++);
+      switch (state) {
+      case TelnetIAC:
+         switch (n) {
+         case TelnetAbortOutput:
+            // Abort all output data.
+            while (Output.head) {
+               block = Output.head;
+               Output.head = block->next;
+               delete block;
             }
+            Output.tail = NULL;
+            Output.blocks = 0;
+            state = 0;
+            break;
+         case TelnetAreYouThere:
+            // Are we here?  Yes!  Queue confirmation to command queue,
+            // to be output as soon as possible.  (Does NOT wait on a
+            // Go Ahead if output is blocked!)
+            command("\r\n[Yes]\r\n");
+            state = 0;
+            break;
+         case TelnetEraseCharacter:
+            // Erase last input character.
+            erase_char();
+            state = 0;
+            break;
+         case TelnetEraseLine:
+            // Erase current input line.
+            erase_line();
+            state = 0;
+            break;
+         case TelnetGoAhead:
+            // Unblock output.
+            if (Output.head) WriteSelect();
+            blocked = false;
+            state = 0;
             break;
          case TelnetWill:
          case TelnetWont:
-            // Negotiate remote option.
-            switch (n) {
-            case TelnetSuppressGoAhead:
-               if (state == TelnetWill) {
-                  RSGA |= TelnetWillWont;
-                  if (!(RSGA & TelnetDoDont)) {
-                     // Turn on SUPPRESS-GO-AHEAD option.
-                     RSGA |= TelnetDoDont;
-                     command(TelnetIAC, TelnetDo, TelnetSuppressGoAhead);
-
-                     // Me, too!
-                     if (!LSGA) set_LSGA(LSGA_callback, true);
-
-                     // Unblock output.
-                     if (Output.head) WriteSelect();
-                     blocked = false;
-                  }
-               } else {
-                  RSGA &= ~TelnetWillWont;
-                  if (RSGA & TelnetDoDont) {
-                     // Turn off SUPPRESS-GO-AHEAD option.
-                     RSGA &= ~TelnetDoDont;
-                     command(TelnetIAC, TelnetDont, TelnetSuppressGoAhead);
-                  }
+         case TelnetDo:
+         case TelnetDont:
+            // Options negotiation.  Remember which type.
+            state = n;
+            break;
+         case TelnetIAC:
+            // Escaped (doubled) TelnetIAC is data.
+            insert_char(TelnetIAC);
+            state = 0;
+            break;
+         case TelnetSubnegotiationBegin:
+            // Collect subnegotiation until IAC SE.
+            sb_len = 0;
+            state = n;
+            break;
+         default:
+            // Ignore any other telnet command.
+            state = 0;
+            break;
+         }
+         break;
+      case TelnetWill:
+      case TelnetWont:
+         // Negotiate remote option.
+         switch (n) {
+         case TelnetSuppressGoAhead:
+            if (state == TelnetWill) {
+               RSGA |= TelnetWillWont;
+               if (!(RSGA & TelnetDoDont)) {
+                  // Turn on SUPPRESS-GO-AHEAD option.
+                  RSGA |= TelnetDoDont;
+                  command(TelnetIAC, TelnetDo, TelnetSuppressGoAhead);
+
+                  // Me, too!
+                  if (!LSGA) set_LSGA(LSGA_callback, true);
+
+                  // Unblock output.
+                  if (Output.head) WriteSelect();
+                  blocked = false;
+               }
+            } else {
+               RSGA &= ~TelnetWillWont;
+               if (RSGA & TelnetDoDont) {
+                  // Turn off SUPPRESS-GO-AHEAD option.
+                  RSGA &= ~TelnetDoDont;
+                  command(TelnetIAC, TelnetDont, TelnetSuppressGoAhead);
                }
-               if (RSGA_callback) {
-                  (this->*RSGA_callback)();
-                  RSGA_callback = NULL;
+            }
+            if (RSGA_callback) {
+               (this->*RSGA_callback)();
+               RSGA_callback = NULL;
+            }
+            break;
+         case TelnetLinemode:
+            if (state == TelnetWill) {
+               if (Linemode == TelnetEnabled) break; // Nothing new.
+               Linemode |= TelnetWillWont;
+               if (!(Linemode & TelnetDoDont)) {
+                  // Turn on LINEMODE option.
+                  Linemode |= TelnetDoDont;
+                  command(TelnetIAC, TelnetDo, TelnetLinemode);
                }
-               break;
-            case TelnetTimingMark:
-               if (acknowledge) {
-                  if (outstanding) outstanding--;
-                  if (session) session->AcknowledgeOutput();
-               } else if (Echo == TelnetWillWont) {
-                  acknowledge = true;
+
+               // Ask client to edit input lines locally.
+               const char mode[] = {
+                  (char) TelnetIAC, (char) TelnetSubnegotiationBegin,
+                  TelnetLinemode, LinemodeMode, LinemodeEdit,
+                  (char) TelnetIAC, (char) TelnetSubnegotiationEnd
+               };
+               command(mode, sizeof(mode));
+            } else {
+               Linemode &= ~TelnetWillWont;
+               if (Linemode & TelnetDoDont) {
+                  // Turn off LINEMODE option.
+                  Linemode &= ~TelnetDoDont;
+                  command(TelnetIAC, TelnetDont, TelnetLinemode);
                }
-               break;
-            default:
-               // Don't know this option, refuse it.
-               if (state == TelnetWill) command(TelnetIAC, TelnetDont, n);
-               break;
+               LineEdit(false);
             }
-            state = 0;
             break;
-         case TelnetDo:
-         case TelnetDont:
-            // Negotiate local option.
-            switch (n) {
-            case TelnetEcho:
-               if (state == TelnetDo) {
-                  Echo |= TelnetDoDont;
-                  if (!(Echo & TelnetWillWont)) {
-                     // Turn on ECHO option.
-                     Echo |= TelnetWillWont;
-                     command(TelnetIAC, TelnetWill, TelnetEcho);
-                  }
-               } else {
+         case TelnetNewEnviron:
+            if (state == TelnetWill) {
+               if (Environ == TelnetEnabled) break; // Nothing new.
+               Environ |= TelnetWillWont;
+               if (!(Environ & TelnetDoDont)) {
+                  // Turn on NEW-ENVIRON option.
+                  Environ |= TelnetDoDont;
+                  command(TelnetIAC, TelnetDo, TelnetNewEnviron);
+               }
+
+               // Ask for the resume token.
+               const char send[] = {
+                  (char) TelnetIAC, (char) TelnetSubnegotiationBegin,
+                  TelnetNewEnviron, EnvironSend, EnvironUservar,
+                  'R', 'E', 'S', 'U', 'M', 'E',
+                  (char) TelnetIAC, (char) TelnetSubnegotiationEnd
+               };
+               command(send, sizeof(send));
+            } else {
+               Environ &= ~TelnetWillWont;
+               if (Environ & TelnetDoDont) {
+                  // Turn off NEW-ENVIRON option.
+                  Environ &= ~TelnetDoDont;
+                  command(TelnetIAC, TelnetDont, TelnetNewEnviron);
+               }
+            }
+            break;
+         case TelnetWindowSize:
+            if (state == TelnetWill) {
+               NAWS |= TelnetWillWont;
+               if (!(NAWS & TelnetDoDont)) {
+                  // Turn on NAWS option.
+                  NAWS |= TelnetDoDont;
+                  command(TelnetIAC, TelnetDo, TelnetWindowSize);
+               }
+            } else {
+               NAWS &= ~TelnetWillWont;
+               if (NAWS & TelnetDoDont) {
+                  // Turn off NAWS option.
+                  NAWS &= ~TelnetDoDont;
+                  command(TelnetIAC, TelnetDont, TelnetWindowSize);
+               }
+            }
+            break;
+         case TelnetTimingMark:
+            if (acknowledge) {
+               if (outstanding) outstanding--;
+               if (session) session->AcknowledgeOutput(this);
+            } else if (Echo == TelnetWillWont) {
+               acknowledge = true;
+            }
+            break;
+         default:
+            // Don't know this option, refuse it.
+            if (state == TelnetWill) command(TelnetIAC, TelnetDont, n);
+            break;
+         }
+         state = 0;
+         break;
+      case TelnetDo:
+      case TelnetDont:
+         // Negotiate local option.
+         switch (n) {
+         case TelnetEcho:
+            if (state == TelnetDo) {
+               Echo |= TelnetDoDont;
+               if (edit && DoEcho && !(Echo & TelnetWillWont)) {
+                  // Client echoes the lines it edits.
                   Echo &= ~TelnetDoDont;
-                  if (Echo & TelnetWillWont) {
-                     // Turn off ECHO option.
-                     Echo &= ~TelnetWillWont;
-                     command(TelnetIAC, TelnetWont, TelnetEcho);
-                  }
+                  command(TelnetIAC, TelnetWont, TelnetEcho);
+               } else if (!(Echo & TelnetWillWont)) {
+                  // Turn on ECHO option.
+                  Echo |= TelnetWillWont;
+                  command(TelnetIAC, TelnetWill, TelnetEcho);
                }
-               if (Echo_callback) {
-                  (this->*Echo_callback)();
-                  Echo_callback = NULL;
+            } else {
+               Echo &= ~TelnetDoDont;
+               if (Echo & TelnetWillWont) {
+                  // Turn off ECHO option.
+                  Echo &= ~TelnetWillWont;
+                  command(TelnetIAC, TelnetWont, TelnetEcho);
                }
-               break;
-            case TelnetSuppressGoAhead:
-               if (state == TelnetDo) {
-                  LSGA |= TelnetDoDont;
-                  if (!(LSGA & TelnetWillWont)) {
-                     // Turn on SUPPRESS-GO-AHEAD option.
-                     LSGA |= TelnetWillWont;
-                     command(TelnetIAC, TelnetWill, TelnetSuppressGoAhead);
-
-                     // You can too.
-                     if (!RSGA) set_RSGA(RSGA_callback, true);
-
-                     // Unblock output.
-                     if (Output.head) WriteSelect();
-                     blocked = false;
-                  }
-               } else {
-                  LSGA &= ~TelnetDoDont;
-                  if (LSGA & TelnetWillWont) {
-                     // Turn off SUPPRESS-GO-AHEAD option.
-                     LSGA &= ~TelnetWillWont;
-                     command(TelnetIAC, TelnetWont, TelnetSuppressGoAhead);
-                  }
+            }
+            if (Echo_callback) {
+               (this->*Echo_callback)();
+               Echo_callback = NULL;
+            }
+            break;
+         case TelnetSuppressGoAhead:
+            if (state == TelnetDo) {
+               LSGA |= TelnetDoDont;
+               if (!(LSGA & TelnetWillWont)) {
+                  // Turn on SUPPRESS-GO-AHEAD option.
+                  LSGA |= TelnetWillWont;
+                  command(TelnetIAC, TelnetWill, TelnetSuppressGoAhead);
+
+                  // You can too.
+                  if (!RSGA) set_RSGA(RSGA_callback, true);
+
+                  // Unblock output.
+                  if (Output.head) WriteSelect();
+                  blocked = false;
                }
-               if (LSGA_callback) {
-                  (this->*LSGA_callback)();
-                  LSGA_callback = NULL;
+            } else {
+               LSGA &= ~TelnetDoDont;
+               if (LSGA & TelnetWillWont) {
+                  // Turn off SUPPRESS-GO-AHEAD option.
+                  LSGA &= ~TelnetWillWont;
+                  command(TelnetIAC, TelnetWont, TelnetSuppressGoAhead);
                }
-               break;
-            default:
-               // Don't know this option, refuse it.
-               if (state == TelnetDo) {
-                  command(TelnetIAC, TelnetWont, n);
+            }
+            if (LSGA_callback) {
+               (this->*LSGA_callback)();
+               LSGA_callback = NULL;
+            }
+            break;
+         case TelnetCompress2:
+            if (state == TelnetDo) {
+               Compress2 |= TelnetDoDont;
+               if (!(Compress2 & TelnetWillWont)) {
+                  // Turn on COMPRESS2 option.
+                  Compress2 |= TelnetWillWont;
+                  command(TelnetIAC, TelnetWill, TelnetCompress2);
                }
-               break;
+               QueueCompress();
+            } else {
+               Compress2 &= ~TelnetDoDont;
+               if (Compress2 & TelnetWillWont) {
+                  // Turn off COMPRESS2 option.
+                  Compress2 &= ~TelnetWillWont;
+                  command(TelnetIAC, TelnetWont, TelnetCompress2);
+               }
+               EndCompress();
             }
+            break;
+         default:
+            // Don't know this option, refuse it.
+            if (state == TelnetDo) {
+               command(TelnetIAC, TelnetWont, n);
+            }
+            break;
+         }
+         state = 0;
+         break;
+      case TelnetSubnegotiationBegin:
+         if (n == TelnetIAC) {
+            state = TelnetSubnegotiationEnd; // IAC within subnegotiation
+         } else if (sb_len < SubnegotiationSize) {
+            sb[sb_len++] = n;
+         }
+         break;
+      case TelnetSubnegotiationEnd:
+         if (n == TelnetIAC) {		// Escaped (doubled) TelnetIAC.
+            if (sb_len < SubnegotiationSize) sb[sb_len++] = n;
+            state = TelnetSubnegotiationBegin;
+         } else {			// IAC SE, or malformed.
+            if (n == TelnetSubnegotiationEnd) Subnegotiation();
+            sb_len = 0;
             state = 0;
+         }
+         break;
+      case Return:
+         // Throw away next character.
+         state = 0;
+         break;
+      case Escape:
+         switch (n) {
+         case '\[':
+            state = CSI;
             break;
-         case Return:
-            // Throw away next character.
+         case ControlL:
+            UndrawInput();
+            output("\033[H\033[J");	// XXX ANSI!
+            if (split) stale = true;
+            RedrawInput();
             state = 0;
             break;
-         case Escape:
-            switch (n) {
-            case '\[':
-               state = CSI;
+         default:
+            output(Bell);
+            state = 0;
+            break;
+         }
+         break;
+      case CSI:
+         switch (n) {
+         case 'A':
+            previous_line();
+            break;
+         case 'B':
+            next_line();
+            break;
+         case 'C':
+            forward_char();
+            break;
+         case 'D':
+            backward_char();
+            break;
+         default:
+            output(Bell);
+            break;
+         }
+         state = 0;
+         break;
+      default:			// Normal data.
+         state = 0;
+         from--;			// Backup to current input character.
+         while (!state && from < from_end && free < end &&
+                line_budget > 0) {
+            switch (n = *((unsigned char *) from++)) {
+            case TelnetIAC:
+               state = TelnetIAC;
+               break;
+            case ControlA:
+               beginning_of_line();
+               break;
+            case ControlB:
+               backward_char();
+               break;
+            case ControlD:
+               delete_char();
+               break;
+            case ControlE:
+               end_of_line();
+               break;
+            case ControlF:
+               forward_char();
+               break;
+            case ControlK:
+               kill_line();
                break;
             case ControlL:
                UndrawInput();
-               output("\033[H\033[J");	// XXX ANSI!
+               if (split) stale = true;
                RedrawInput();
-               state = 0;
                break;
-            default:
-               output(Bell);
-               state = 0;
+            case ControlN:
+               next_line();
                break;
-            }
-            break;
-         case CSI:
-            switch (n) {
-            case 'A':
+            case ControlP:
                previous_line();
                break;
-            case 'B':
-               next_line();
+            case ControlT:
+               transpose_chars();
                break;
-            case 'C':
-               forward_char();
+            case ControlY:
+               yank();
                break;
-            case 'D':
-               backward_char();
+            case Backspace:
+            case Delete:
+               erase_char();
                break;
-            default:
-               output(Bell);
+            case Return:
+               state = Return;
+               // fall through...
+            case Newline:
+               accept_input();
+               break;
+            case Escape:
+               state = Escape;
+               break;
+            case CSI:
+               state = CSI;
+               break;
+            default:			// XXX Add : and ; rules!
+               insert_char(n);
                break;
             }
-            state = 0;
-            break;
-         default:			// Normal data.
-            state = 0;
-            from--;			// Backup to current input character.
-            while (!state && from < from_end && free < end) {
-               switch (n = *((unsigned char *) from++)) {
-               case TelnetIAC:
-                  state = TelnetIAC;
-                  break;
-               case ControlA:
-                  beginning_of_line();
-                  break;
-               case ControlB:
-                  backward_char();
-                  break;
-               case ControlD:
-                  delete_char();
-                  break;
-               case ControlE:
-                  end_of_line();
-                  break;
-               case ControlF:
-                  forward_char();
-                  break;
-               case ControlK:
-                  kill_line();
-                  break;
-               case ControlL:
-                  UndrawInput();
-                  RedrawInput();
-                  break;
-               case ControlN:
-                  next_line();
-                  break;
-               case ControlP:
-                  previous_line();
-                  break;
-               case ControlT:
-                  transpose_chars();
-                  break;
-               case ControlY:
-                  yank();
-                  break;
-               case Backspace:
-               case Delete:
-                  erase_char();
-                  break;
-               case Return:
-                  state = Return;
-                  // fall through...
-               case Newline:
-                  accept_input();
-                  break;
-               case Escape:
-                  state = Escape;
-                  break;
-               case CSI:
-                  state = CSI;
-                  break;
-               default:			// XXX Add : and ; rules!
-                  insert_char(n);
-                  break;
-               }
-            }
-            break;
          }
+         break;
       }
-      break;
    }
-   if (closing && !outstanding && !Command.head && !Output.head) Closed();
+   return from - buf;
 }
 
 void Telnet::OutputReady()		// Telnet stream can output data.
 {
+   struct iovec iov[WriteVectors];	// user data blocks to write at once
    Block *block;
    register int n;
+   int i, len;
+   int written = 0;			// user data written this turn
 
    if (fd == -1) return;
+   if (zout || Deflated.head) {		// Compressing, or finishing that.
+      OutputCompressed();
+      return;
+   }
 
-   // Send command data, if any.
+   // Send command data, if any, up to the start of compressed output.
    while (Command.head) {
       block = Command.head;
-      n = write(fd, block->data, block->free - block->data);
+      len = block->free - block->data;
+      if (zstart && len > zstart) len = zstart;
+      n = write(fd, block->data, len);
       switch (n) {
       case -1:
          switch (errno) {
@@ -967,6 +1768,7 @@ void Telnet::OutputReady()		// Telnet stream can output data.
             return;
          case ECONNRESET:
          case ECONNTIMEDOUT:
+         case EPIPE:
             Closed();
             return;
          default:
@@ -983,8 +1785,16 @@ void Telnet::OutputReady()		// Telnet stream can output data.
             } else {
                Command.head = Command.tail = NULL;
             }
+            Command.blocks--;
             delete block;
          }
+         if (zstart && !(zstart -= n)) {
+            StartCompress();
+            if (zout) {
+               OutputCompressed();
+               return;
+            }
+         }
          break;
       }
    }
@@ -995,12 +1805,17 @@ void Telnet::OutputReady()		// Telnet stream can output data.
       return;
    }
 
-   // Send user data, if any.
+   // Send user data, if any, up to the write budget.  The rest goes out on
+   // later turns, after other connections have had a chance to write.
    while (Output.head) {
       while (Output.head) {
-         block = Output.head;
-         block = Output.head;
-         n = write(fd, block->data, block->free - block->data);
+         if (written >= WriteBudget) return;
+         for (i = 0, block = Output.head; block && i < WriteVectors;
+              i++, block = block->next) {
+            iov[i].iov_base = (void *) block->data;
+            iov[i].iov_len = block->free - block->data;
+         }
+         n = writev(fd, iov, i);
          switch (n) {
          case -1:
             switch (errno) {
@@ -1010,21 +1825,34 @@ void Telnet::OutputReady()		// Telnet stream can output data.
             case EAGAIN:
 #endif
                return;
+            case ECONNRESET:
+            case ECONNTIMEDOUT:
+            case EPIPE:
+               Closed();
+               return;
             default:
-               warn("Telnet::OutputReady(): write(fd = %d)", fd);
+               warn("Telnet::OutputReady(): writev(fd = %d)", fd);
                Closed();
                return;
             }
             break;
          default:
-            block->data += n;
-            if (block->data >= block->free) {
+            written += n;
+            while (n > 0 && (block = Output.head)) {
+               len = block->free - block->data;
+               if (n < len) {		// Partially written block.
+                  block->data += n;
+                  break;
+               }
+               n -= len;
                if (block->next) {
                   Output.head = block->next;
                } else {
                   Output.head = Output.tail = NULL;
                }
+               Output.blocks--;
                delete block;
+               if (held && Output.blocks <= OutputLowMark) ResumeOutput();
             }
             break;
          }
@@ -1044,7 +1872,7 @@ void Telnet::OutputReady()		// Telnet stream can output data.
       // Telnet buffers as it is queued.
 
       if (!acknowledge && session) {
-         session->AcknowledgeOutput();
+         session->AcknowledgeOutput(this);
          session->OutputNext(this);
       }
    }
@@ -1066,3 +1894,100 @@ void Telnet::OutputReady()		// Telnet stream can output data.
       if (!RSGA) blocked = true;
    }
 }
+
+// Send compressed output.  Queued output is compressed a write budget's
+// worth at a time, once everything compressed before it has been written.
+// Output compressed before the end of a stream is sent even after
+// compression is turned off, then the rest goes out uncompressed.
+void Telnet::OutputCompressed()
+{
+   struct iovec iov[WriteVectors];	// compressed blocks to write at once
+   Block *block;
+   register int n;
+   int i, len;
+   bool fresh = true;			// compress more this turn?
+
+   for (;;) {
+      if (!Deflated.head) {
+         if (!zout) {			// Stream ended, carry on uncompressed.
+            OutputReady();
+            return;
+         }
+         if (!fresh || !(Command.head || (Output.head && !blocked))) break;
+         fresh = false;
+         Deflate(Command, INT_MAX, Z_NO_FLUSH);
+         Deflate(Output, blocked ? 0 : WriteBudget, Z_SYNC_FLUSH);
+      }
+      for (i = 0, block = Deflated.head; block && i < WriteVectors;
+           i++, block = block->next) {
+         iov[i].iov_base = (void *) block->data;
+         iov[i].iov_len = block->free - block->data;
+      }
+      n = writev(fd, iov, i);
+      if (n == -1) {
+         switch (errno) {
+         case EINTR:
+         case EWOULDBLOCK:
+#if EAGAIN != EWOULDBLOCK
+         case EAGAIN:
+#endif
+            return;
+         case ECONNRESET:
+         case ECONNTIMEDOUT:
+         case EPIPE:
+            Closed();
+            return;
+         default:
+            warn("Telnet::OutputCompressed(): writev(fd = %d)", fd);
+            Closed();
+            return;
+         }
+      }
+      while (n > 0 && (block = Deflated.head)) {
+         len = block->free - block->data;
+         if (n < len) {			// Partially written block.
+            block->data += n;
+            break;
+         }
+         n -= len;
+         if (block->next) {
+            Deflated.head = block->next;
+         } else {
+            Deflated.head = Deflated.tail = NULL;
+         }
+         Deflated.blocks--;
+         delete block;
+      }
+   }
+
+   // More to compress next turn?
+   if (Command.head || (Output.head && !blocked)) return;
+   if (blocked) {
+      NoWriteSelect();
+      return;
+   }
+
+   // Fake acknowledgements, as for uncompressed output.
+   if (!acknowledge && session) {
+      session->AcknowledgeOutput(this);
+      session->OutputNext(this);
+      if (Output.head) return;
+   }
+
+   // Done sending all queued output.
+   NoWriteSelect();
+
+   // Close connection if ready to.
+   if (closing && !outstanding) {
+      Closed();
+      return;
+   }
+
+   // Do the Go Ahead thing, if we must.
+   if (!LSGA) {
+      command(TelnetIAC, TelnetGoAhead);
+
+      // Only block if both sides are doing Go Aheads.
+      if (!RSGA) blocked = true;
+   }
+}
@@ -16,7 +16,9 @@
 #include "fdtable.h"
 #include "outbuf.h"
 #include "output.h"
+#include "outstr.h"
 #include "phoenix.h"
+#include "timer.h"
 
 // Telnet commands.
 enum TelnetCommand {
@@ -42,9 +44,38 @@ enum TelnetCommand {
 enum TelnetOption {
    TelnetEcho = 1,
    TelnetSuppressGoAhead = 3,
-   TelnetTimingMark = 6
+   TelnetTimingMark = 6,
+   TelnetWindowSize = 31,
+   TelnetLinemode = 34,
+   TelnetNewEnviron = 39,
+   TelnetCompress2 = 86
 };
 
+// LINEMODE option subnegotiation commands. (RFC 1184)
+enum LinemodeCommand {
+   LinemodeMode = 1,
+   LinemodeForwardMask = 2,
+   LinemodeSLC = 3
+};
+
+// NEW-ENVIRON option subnegotiation commands and codes. (RFC 1572)
+enum EnvironCommand {
+   EnvironIs = 0,
+   EnvironSend = 1,
+   EnvironInfo = 2
+};
+enum EnvironCode {
+   EnvironVar = 0,
+   EnvironValue = 1,
+   EnvironEsc = 2,
+   EnvironUservar = 3
+};
+
+// LINEMODE option MODE bits.
+static const int LinemodeEdit = 1;
+static const int LinemodeTrapSig = 2;
+static const int LinemodeModeAck = 4;
+
 // Telnet option bits.
 static const int TelnetWillWont = 1;
 static const int TelnetDoDont = 2;
@@ -57,39 +88,77 @@ static const int TelnetEnabled = (TelnetDoDont|TelnetWillWont);
 // Data about a particular telnet connection (subclass of FD).
 class Telnet: public FD {
 protected:
-   void LogCaller();			// Log calling host and port.
+   static int slow_readers;		// times output backed up
+   static int slow_detached;		// slow readers detached
+
+   void Init();				// Initialize connection state.
+   void LogCaller(struct sockaddr_in &saddr); // Log calling host and port.
 public:
-   static const int width = 80;		// XXX Hardcoded screen width
-   static const int height = 24;	// XXX Hardcoded screen height
+   int width;				// screen width
+   int height;				// screen height
    Pointer<Session> session;		// link to session object
+   Pointer<Telnet> also;		// next connection for same session
+   OutputStream::OutputObject *sent;	// last output object sent
+   int Sent;				// count of sent output objects
+   int Acknowledged;			// count of acknowledged output objects
+   in_addr_t addr;			// caller's address (0 if untracked)
    char *data;				// start of input data
    char *free;				// start of free area of allocated block
    const char *end;			// end of allocated block (+1)
    char *point;				// current point location
    const char *mark;			// current mark location
+   char *unread;			// received input not yet processed
+   int unread_len;			// length of unprocessed input
+   int unread_pos;			// position in unprocessed input
+   int line_budget;			// input lines left for this turn
    char *prompt;			// current prompt
    int prompt_len;			// length of current prompt
    Pointer<Name> reply_to;		// sender of last private message
    OutputBuffer Output;			// pending data output
    OutputBuffer Command;		// pending command output
+   OutputBuffer Deflated;		// pending compressed output
+   struct z_stream_s *zout;		// output compressor (MCCP2)
+   int zstart;				// command bytes left before compressing
    int outstanding;			// outstanding acknowledgement count
-   unsigned char state;			// state (0/\r/IAC/WILL/WONT/DO/DONT)
+   unsigned char state;			// state (0/\r/IAC/WILL/WONT/DO/DONT/SB)
+   unsigned char sb[SubnegotiationSize]; // subnegotiation being received
+   int sb_len;				// subnegotiation bytes received
    bool undrawn;			// input line undrawn for output?
+   bool split;				// input line pinned below scroll region?
+   bool stale;				// split-screen input line needs redraw?
+   int split_rows;			// screen rows reserved for input line
    bool blocked;			// output blocked?
    bool closing;			// connection closing?
+   bool dirty;				// output objects waiting to render?
+   bool held;				// output held at high mark?
+   bool slow;				// flagged as a slow reader?
+   int slow_count;			// times flagged as a slow reader
    bool acknowledge;			// use telnet TIMING-MARK option?
    bool DoEcho;				// should server do echo?
+   bool edit;				// client editing input lines locally?
    char Echo;				// ECHO option (local)
+   char Linemode;			// LINEMODE option (remote)
+   char NAWS;				// NAWS option (remote)
+   char Environ;			// NEW-ENVIRON option (remote)
+   char Compress2;			// COMPRESS2 option (local)
    char LSGA;				// SUPPRESS-GO-AHEAD option (local)
    char RSGA;				// SUPPRESS-GO-AHEAD option (remote)
    CallbackFuncPtr Echo_callback;	// ECHO callback (local)
    CallbackFuncPtr LSGA_callback;	// SUPPRESS-GO-AHEAD callback (local)
    CallbackFuncPtr RSGA_callback;	// SUPPRESS-GO-AHEAD callback (remote)
+   MemberTimer<Telnet> idle;		// login or idle timer
+   MemberTimer<Telnet> overflow;	// slow reader detach timer
 
-   Telnet(int lfd);			// constructor
+   Telnet(int sock, struct sockaddr_in &saddr); // constructor
+   Telnet();				// constructor (handed-off connection)
    ~Telnet();				// destructor
    void Closed();			// Connection is closed.
-   void Prompt(const char *p);		// Print and set new prompt.
+   void Save(Handoff &h);		// Save connection state for handoff.
+   void Restore(Handoff &h, Session *s, Pointer<Session> *list, int n);
+   virtual void Prompt(const char *p);	// Print and set new prompt.
+   void Dirty();			// Render output objects in flush phase.
+   void Render();			// Render waiting output objects now.
+   void Flush();			// Render and write output now.
    bool AtEnd() { return point == free; } // point at end of input?
    int Start() { return prompt_len; }	// start of input (after prompt)
    int StartLine() { return Start() / width; } // start of input line
@@ -104,9 +173,12 @@ public:
    int EndLine() { return (Start() + End()) / width; } // end of input line
    int EndColumn() { return (Start() + End()) % width; } // end of input column
    void Close(bool drain = true);	// Close telnet connection.
-   void output(int byte);		// queue output byte
-   void output(const char *buf);	// queue output data
-   void output(const char *buf, int len); // queue output data (with length)
+   virtual void output(int byte);	// queue output byte
+   virtual void output(const char *buf); // queue output data
+   virtual void output(const char *buf, int len); // queue output data (w/len)
+   virtual void Send(::Output *out) {	// Send output object.
+      out->output(this);
+   }
    void print(const char *format, ...);	// formatted write
    void echo(int byte);			// echo output byte
    void echo(const char *buf);		// echo output data
@@ -119,13 +191,34 @@ public:
    void command(int byte1, int byte2, int byte3); // Queue 3 command bytes.
    void TimingMark(void);		// Queue TIMING-MARK telnet option.
    void PrintMessage(OutputType type, time_t time, Name *from,
-                     const char *start); // Print user message.
+                     const char *sendlist, const char *text,
+                     Wrap *layout);	// Print user message.
    void Welcome();			// Send welcome banner and login prompt.
-   void UndrawInput();			// Erase input line from screen.
-   void RedrawInput();			// Redraw input line on screen.
+   void SetIdleTimer();			// Restart login or idle timer.
+   void IdleTimedOut();			// Login or idle timer expired.
+   void SlowReader();			// Flag connection as a slow reader.
+   void ResumeOutput();			// Resume output held at high mark.
+   void DetachSlowReader();		// Detach hopelessly slow reader.
+   static void LogStats();		// Log slow reader statistics.
+   virtual void UndrawInput();		// Erase input line from screen.
+   virtual void RedrawInput();		// Redraw input line on screen.
+   bool SplitScreen(bool on);		// Pin input line below scroll region.
+   int InputRow() { return height - split_rows + 1; } // first input row
+   void DrawInput();			// Draw split-screen input line afresh.
+   void FitInput();			// Grow split-screen input area to fit.
+   void ScrollInput();			// Scroll accepted input into output.
    void set_Echo(CallbackFuncPtr callback, int state); // Set local ECHO option.
    void set_LSGA(CallbackFuncPtr callback, int state); // Set local SGA option.
    void set_RSGA(CallbackFuncPtr callback, int state); // Set remote SGA option.
+   void EchoInput(bool on);		// Echo input, or hide it.
+   void LineEdit(bool on);		// Client editing lines locally, or not.
+   void Subnegotiation();		// Process received subnegotiation.
+   void Environment();			// Process NEW-ENVIRON variables.
+   void Resize(int w, int h);		// Set screen size. (0 = unknown)
+   void QueueCompress();		// Queue start of compressed output.
+   void StartCompress();		// Start compressing output.
+   int Deflate(OutputBuffer &buf, int max, int flush); // Compress output.
+   void EndCompress();			// Finish compressed output stream.
    void beginning_of_line();		// Jump to beginning of line.
    void end_of_line();			// Jump to end of line.
    void kill_line();			// Kill from point to end of line.
@@ -140,8 +233,10 @@ public:
    void erase_char();			// Erase input character before point.
    void delete_char();			// Delete character at point.
    void transpose_chars();		// Transpose characters at point.
+   virtual int Receive(const char *buf, int len); // Process input, to budget.
    void InputReady();			// Telnet stream can input data.
    void OutputReady();			// Telnet stream can output data.
+   void OutputCompressed();		// Send compressed output.
 };
 
 #endif // telnet.h
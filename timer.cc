@@ -0,0 +1,135 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// timer.cc -- Timer class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "phoenix.h"
+#include "timer.h"
+
+Timer *Timer::wheel[TimerLevels][TimerSlots]; // timer wheel
+Timer *Timer::expired = NULL;		// expired timers being run
+long long Timer::current = -1;		// next tick to process
+int Timer::pending = 0;			// number of timers set
+
+static const int SlotBits = 6;		// log2(TimerSlots)
+static const int SlotMask = TimerSlots - 1;
+
+long long Timer::Now()			// Current time in ticks.
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ((long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / TimerTick;
+}
+
+void Timer::Insert()			// Insert timer into wheel.
+{
+   long long delta = expires - current, when = expires;
+   int level;
+
+   if (delta < 0) when = current;	// Overdue, run on next tick.
+   for (level = 0; level < TimerLevels - 1; level++) {
+      if (delta < (1LL << (SlotBits * (level + 1)))) break;
+   }
+   if (level == TimerLevels - 1 &&
+       delta >= (1LL << (SlotBits * TimerLevels))) {
+      when = current + (1LL << (SlotBits * TimerLevels)) - 1; // Clamp.
+   }
+   slot = &wheel[level][(when >> (SlotBits * level)) & SlotMask];
+   prev = NULL;
+   next = *slot;
+   if (next) next->prev = this;
+   *slot = this;
+}
+
+void Timer::SetMsec(int msec)		// Set timer to expire in milliseconds.
+{
+   Cancel();
+   if (current < 0) current = Now();
+   expires = Now() + (msec + TimerTick - 1) / TimerTick;
+   Insert();
+   pending++;
+}
+
+void Timer::Cancel()			// Cancel timer, if set.
+{
+   if (!slot) return;
+   if (prev) {
+      prev->next = next;
+   } else {
+      *slot = next;
+   }
+   if (next) next->prev = prev;
+   next = prev = NULL;
+   slot = NULL;
+   pending--;
+}
+
+void Timer::Cascade(int level)		// Move a slot's timers down a level.
+{
+   Timer **slot = &wheel[level][(current >> (SlotBits * level)) & SlotMask];
+   Timer *timer, *list = *slot;
+
+   *slot = NULL;
+   while ((timer = list)) {
+      list = timer->next;
+      timer->Insert();
+   }
+}
+
+// Set select() timeout for the next tick that might have a timer to run,
+// or return NULL if there are no timers.  Only the lowest level is searched,
+// otherwise this wakes up in time for the next cascade.
+struct timeval *Timer::Timeout(struct timeval &tv)
+{
+   long long now, next;
+   int i;
+
+   if (!pending) return NULL;
+   for (i = 0, next = current; i < TimerSlots; i++, next++) {
+      if (wheel[0][next & SlotMask]) break;
+      if (!((next + 1) & SlotMask)) {	// Cascade point.
+         next++;
+         break;
+      }
+   }
+   now = Now();
+   if (next < now) next = now;
+   next = (next - now) * TimerTick;
+   tv.tv_sec = next / 1000;
+   tv.tv_usec = next % 1000 * 1000;
+   return &tv;
+}
+
+void Timer::Run()			// Run expired timers.
+{
+   long long now = Now();
+   Timer *timer;
+   int level;
+
+   if (current < 0 || !pending) current = now; // Nothing to catch up on.
+   while (current <= now) {
+      // Cascade higher levels down when the lower level wraps around.
+      for (level = 1; level < TimerLevels; level++) {
+         if (current & ((1LL << (SlotBits * level)) - 1)) break;
+         Cascade(level);
+      }
+
+      // Move this tick's timers to the expired list, then run them.  Timers
+      // set while running go into later ticks, and timers cancelled (or
+      // destroyed) by another timer are just unlinked from the list.
+      expired = wheel[0][current & SlotMask];
+      wheel[0][current & SlotMask] = NULL;
+      for (timer = expired; timer; timer = timer->next) timer->slot = &expired;
+      current++;
+      while ((timer = expired)) {
+         timer->Cancel();
+         timer->Fire();			// Might delete timer.
+      }
+   }
+}
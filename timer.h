@@ -0,0 +1,82 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// timer.h -- Timer class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _TIMER_H
+#define _TIMER_H 1
+
+// Include files.
+#include "phoenix.h"
+
+// Timers are kept in a hashed hierarchical timer wheel: TimerLevels levels
+// of TimerSlots slots each, with each level covering TimerSlots times the
+// span of the one below.  A timer goes into the slot for its expiry time at
+// the lowest level whose span covers it, in a doubly-linked list, so setting
+// and cancelling a timer are O(1).  As time passes, each slot of a higher
+// level is cascaded down into the lower levels when its turn comes up.
+//
+// The wheel is driven from the main loop: FDTable::Select() uses the time
+// until the next timer could expire as its select() timeout, and runs any
+// expired timers afterward.  Timers never run in signal handlers.
+class Timer {
+private:
+   static Timer *wheel[TimerLevels][TimerSlots]; // timer wheel
+   static Timer *expired;		// expired timers being run
+   static long long current;		// next tick to process
+   static int pending;			// number of timers set
+
+   Timer *next;				// next timer in slot
+   Timer *prev;				// previous timer in slot
+   Timer **slot;			// slot timer is in (NULL if not set)
+   long long expires;			// tick timer expires on
+
+   void Insert();			// Insert timer into wheel.
+   static void Cascade(int level);	// Move a slot's timers down a level.
+public:
+   Timer() {				// constructor
+      next = prev = NULL;
+      slot = NULL;
+      expires = 0;
+   }
+   virtual ~Timer() { Cancel(); }	// destructor
+   void Set(int seconds) {		// Set timer to expire in seconds.
+      SetMsec(seconds * 1000);
+   }
+   void SetMsec(int msec);		// Set timer to expire in milliseconds.
+   void Cancel();			// Cancel timer, if set.
+   bool IsSet() { return slot != NULL; } // Is timer set?
+   virtual void Fire() = 0;		// Timer expired.
+
+   static long long Now();		// Current time in ticks.
+
+   static struct timeval *Timeout(struct timeval &tv); // Time until next.
+   static void Run();			// Run expired timers.
+};
+
+// Timer calling a plain function.
+class FunctionTimer: public Timer {
+private:
+   void (*func)();			// function to call
+public:
+   FunctionTimer(void (*f)()): func(f) { } // constructor
+   void Fire() { func(); }		// Timer expired.
+};
+
+// Timer calling a member function of an object.
+template <class Type>
+class MemberTimer: public Timer {
+private:
+   Type *obj;				// object to call
+   void (Type::*func)();		// member function to call
+public:
+   MemberTimer(Type *o, void (Type::*f)()): obj(o), func(f) { }
+   void Fire() { (obj->*func)(); }	// Timer expired.
+};
+
+#endif // timer.h
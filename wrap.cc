@@ -0,0 +1,81 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// wrap.cc -- Wrap class implementation.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Include files.
+#include "phoenix.h"
+#include "wrap.h"
+
+// Break lines at the last space before the continuation prefix would wrap,
+// or at the screen edge if there is no space.  The first pass counts lines,
+// the second records them.
+Wrap::Wrap(const char *text, int w)	// constructor
+{
+   const char *s, *wrap, *p;
+   int col, pass;
+
+   width = w;
+   start = length = NULL;
+   next = NULL;
+   for (pass = 0; pass < 2; pass++) {
+      lines = 0;
+      s = text;
+      while (*s) {
+         wrap = NULL;
+         for (p = s, col = 0; *p && col < width - 4; p++, col++) {
+            if (*p == Space) wrap = p;
+         }
+         if (!*p || !wrap) {
+            if (start) {
+               start[lines] = s - text;
+               length[lines] = p - s;
+            }
+            s = p;
+         } else {
+            if (start) {
+               start[lines] = s - text;
+               length[lines] = wrap - s;
+            }
+            s = wrap + 1;
+            if (*s == Space) s++;
+         }
+         lines++;
+
+         // Text ending where a line wrapped still gets an empty last line.
+         if (!*s && *p) {
+            if (start) start[lines] = length[lines] = 0;
+            lines++;
+         }
+      }
+      if (!pass) {
+         start = new int[lines + 1];
+         length = new int[lines + 1];
+      }
+   }
+}
+
+Wrap::~Wrap()				// destructor
+{
+   delete[] start;
+   delete[] length;
+   if (next) delete next;
+}
+
+// Find layout for width in list, or compute it and add it to the list.
+Wrap *Wrap::Find(Wrap *&list, const char *text, int w)
+{
+   Wrap *layout;
+
+   for (layout = list; layout; layout = layout->next) {
+      if (layout->width == w) return layout;
+   }
+   layout = new Wrap(text, w);
+   layout->next = list;
+   list = layout;
+   return layout;
+}
@@ -0,0 +1,33 @@
+// -*- C++ -*-
+//
+// Phoenix conferencing system server.
+//
+// wrap.h -- Wrap class interface.
+//
+// Copyright (c) 2026 Deven T. Corzine
+//
+
+// Check if previously included.
+#ifndef _WRAP_H
+#define _WRAP_H 1
+
+// Include files.
+#include "phoenix.h"
+
+// Word wrap layout of a message's text for one screen width, as offsets
+// and lengths of each line.  A message keeps the layouts computed for it,
+// so every recipient with the same screen width shares one.
+class Wrap {
+public:
+   int width;				// screen width wrapped for
+   int lines;				// number of lines
+   int *start;				// offset of each line in text
+   int *length;				// length of each line
+   Wrap *next;				// next layout of same text
+
+   Wrap(const char *text, int w);	// constructor
+   ~Wrap();				// destructor
+   static Wrap *Find(Wrap *&list, const char *text, int w); // Find layout.
+};
+
+#endif // wrap.h